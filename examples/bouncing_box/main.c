@@ -2,14 +2,15 @@
  * pico_hdmi Bouncing Box Example
  *
  * Demonstrates basic usage of the pico_hdmi library:
- * - 640x480 @ 60Hz HDMI output
- * - Scanline callback for rendering
+ * - 640x480 @ 60Hz HDMI output from 320-pixel lines, doubled by the HSTX
+ * - Cached scanline callback: only lines that differ from the one above are drawn
  * - HDMI audio (Für Elise melody)
  * - Simple animation
  *
  * Target: RP2350 (Raspberry Pi Pico 2)
  */
 
+#include "pico_hdmi/hstx_audio_fifo.h"
 #include "pico_hdmi/hstx_data_island_queue.h"
 #include "pico_hdmi/hstx_packet.h"
 #include "pico_hdmi/video_output.h"
@@ -27,21 +28,27 @@
 // Configuration
 // ============================================================================
 
-#define FRAME_WIDTH 640
-#define FRAME_HEIGHT 480
+// Any entry of video_modes[]; the frame follows its active area
+#define VIDEO_MODE VIDEO_MODE_320X480P60
+#define FRAME_WIDTH (video_mode_source_width(&video_modes[VIDEO_MODE]))
+#define FRAME_HEIGHT (video_modes[VIDEO_MODE].v_active_lines)
+// Output pixels per frame pixel across: 2 in a h_pixel_double mode
+#define H_SCALE ((int)(video_modes[VIDEO_MODE].h_active_pixels / FRAME_WIDTH))
 
-#define BOX_SIZE 32
+#define BOX_SIZE 32 // Output pixels, so the box stays square when lines are doubled
 #define BG_COLOR 0x0010  // Dark blue (RGB565)
 #define BOX_COLOR 0xFFE0 // Yellow (RGB565)
 
 // Audio configuration
 #define AUDIO_SAMPLE_RATE 48000
 #define TONE_AMPLITUDE 6000
+#define AUDIO_BLOCK_SAMPLES 800 // One video frame at 48 kHz
 
 // ============================================================================
 // Animation State
 // ============================================================================
 
+// In output pixels; the callback scales x to frame pixels
 static volatile int box_x = 50, box_y = 50;
 static int box_dx = 2, box_dy = 1;
 
@@ -53,7 +60,6 @@ static int box_dx = 2, box_dy = 1;
 static int16_t sine_table[SINE_TABLE_SIZE];
 static uint32_t audio_phase = 0;
 static uint32_t phase_increment = 0;
-static int audio_frame_counter = 0;
 
 // Use Korobeiniki for the demo (Für Elise kept for reference)
 
@@ -96,29 +102,41 @@ static inline int16_t get_sine_sample(void)
 
 static void generate_audio(void)
 {
-    // Keep the audio queue fed
-    while (hstx_di_queue_get_level() < 200) {
-        audio_sample_t samples[4];
-        for (int i = 0; i < 4; i++) {
-            int16_t s = get_sine_sample();
-            samples[i].left = s;
-            samples[i].right = s;
-        }
-
-        hstx_packet_t packet;
-        audio_frame_counter = hstx_packet_set_audio_samples(&packet, samples, 4, audio_frame_counter);
-
-        hstx_data_island_t island;
-        hstx_encode_data_island(&island, &packet, false, true);
-        hstx_di_queue_push(&island);
+    // Keep the PCM FIFO topped up; Core 1 packetises and encodes it
+    static audio_sample_t block[AUDIO_BLOCK_SAMPLES];
+    uint32_t count = hstx_audio_fifo_get_free();
+    if (count > AUDIO_BLOCK_SAMPLES)
+        count = AUDIO_BLOCK_SAMPLES;
+
+    for (uint32_t i = 0; i < count; i++) {
+        int16_t s = get_sine_sample();
+        block[i].left = s;
+        block[i].right = s;
     }
+    hstx_audio_fifo_write(block, count);
 }
 
 // ============================================================================
 // Scanline Callback (runs on Core 1)
 // ============================================================================
 
-void __scratch_x("") scanline_callback(uint32_t v_scanline, uint32_t active_line, uint32_t *dst)
+// Pixels [from, to) of a line: an odd pixel at either end on its own, the pairs
+// between as 32-bit stores
+static void __not_in_flash_func(fill_pixels)(uint32_t *dst, int from, int to, uint16_t colour)
+{
+    uint16_t *px = (uint16_t *)dst;
+    uint32_t pair = colour | ((uint32_t)colour << 16);
+
+    if (from < to && (from & 1))
+        px[from++] = colour;
+    for (; from + 1 < to; from += 2)
+        dst[from / 2] = pair;
+    if (from < to)
+        px[from] = colour;
+}
+
+// In SRAM: scratch X is left to the library's DMA ISR and Core 1's stack
+uint32_t __not_in_flash_func(scanline_callback)(uint32_t v_scanline, uint32_t active_line, uint32_t *dst)
 {
     (void)v_scanline;
 
@@ -128,35 +146,28 @@ void __scratch_x("") scanline_callback(uint32_t v_scanline, uint32_t active_line
     int bx = box_x;
     int by = box_y;
 
-    uint32_t bg = BG_COLOR | (BG_COLOR << 16);
-    uint32_t box = BOX_COLOR | (BOX_COLOR << 16);
+    // A line like the one above it is sent again from the line cache
+    bool in_box = fb_line >= by && fb_line < by + BOX_SIZE;
+    bool above_in_box = fb_line - 1 >= by && fb_line - 1 < by + BOX_SIZE;
+    if (fb_line > 0 && in_box == above_in_box)
+        return active_line - 1;
 
     // Check if this line intersects the box vertically
-    if (fb_line >= by && fb_line < by + BOX_SIZE) {
-        // Three regions: before box, box, after box
-        int i = 0;
-
-        // Region 1: before box
-        // Note: iterating by 2 pixels at a time (1 uint32_t)
-        for (; i < bx / 2; i++) {
-            dst[i] = bg;
-        }
-
-        // Region 2: box
-        for (; i < (bx + BOX_SIZE) / 2 && i < FRAME_WIDTH / 2; i++) {
-            dst[i] = box;
-        }
-
-        // Region 3: after box
-        for (; i < FRAME_WIDTH / 2; i++) {
-            dst[i] = bg;
-        }
+    if (in_box) {
+        // Three regions: before box, box, after box. With doubled lines the box
+        // edges fall on any frame pixel.
+        int left = bx / H_SCALE;
+        int right = (bx + BOX_SIZE) / H_SCALE;
+        if (right > (int)FRAME_WIDTH)
+            right = (int)FRAME_WIDTH;
+        fill_pixels(dst, 0, left, BG_COLOR);
+        fill_pixels(dst, left, right, BOX_COLOR);
+        fill_pixels(dst, right, (int)FRAME_WIDTH, BG_COLOR);
     } else {
         // Fast path: entire line is background
-        for (int i = 0; i < FRAME_WIDTH / 2; i++) {
-            dst[i] = bg;
-        }
+        fill_pixels(dst, 0, (int)FRAME_WIDTH, BG_COLOR);
     }
+    return active_line;
 }
 
 // ============================================================================
@@ -168,7 +179,7 @@ static void update_box(void)
     int x = box_x + box_dx;
     int y = box_y + box_dy;
 
-    if (x <= 0 || x + BOX_SIZE >= FRAME_WIDTH) {
+    if (x <= 0 || x + BOX_SIZE >= (int)FRAME_WIDTH * H_SCALE) {
         box_dx = -box_dx;
         x = box_x + box_dx;
     }
@@ -183,8 +194,9 @@ static void update_box(void)
 
 int main(void)
 {
-    // Set system clock to 126 MHz for HSTX timing
-    set_sys_clock_khz(126000, true);
+    // HSTX runs from clk_sys: 126 MHz for 640x480
+    const video_mode_t *mode = &video_modes[VIDEO_MODE];
+    set_sys_clock_khz(video_mode_sys_clock_khz(mode), true);
 
     stdio_init_all();
 
@@ -201,10 +213,12 @@ int main(void)
 
     // Initialize HDMI output
     hstx_di_queue_init();
+    hstx_audio_fifo_init();
+    video_output_set_mode(mode);
     video_output_init(FRAME_WIDTH, FRAME_HEIGHT);
 
     // Register scanline callback
-    video_output_set_scanline_callback(scanline_callback);
+    video_output_set_cached_scanline_callback(scanline_callback);
 
     // Pre-fill audio buffer
     generate_audio();
@@ -0,0 +1,485 @@
+/**
+ * hdmi_bench - time the packet encoders and palette kernels against reference implementations.
+ *
+ * Usage: hdmi_bench [-n iterations]
+ *
+ * Before timing, every optimised path is checked bit-exact against its
+ * reference in ref_packet.c over a pool of random packets, and its output is
+ * run back through tmds_decode and hstx_decode_data_island(). The palette
+ * kernels are checked against a per-pixel lookup over random index lines.
+ * Exits non-zero on any mismatch.
+ */
+
+#include "pico_hdmi/hstx_data_island_queue.h"
+#include "pico_hdmi/hstx_packet.h"
+#include "pico_hdmi/video_palette.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ref_packet.h"
+#include "tmds_decode.h"
+
+#define POOL_SIZE 256
+#define SINK_SIZE 64 // Rotate outputs like the island ring does, instead of hammering one buffer
+#define ROUNDS 100 // Short rounds, so that most run uninterrupted
+#define BLOCK_SAMPLES 800 // One frame of 48 kHz audio
+#define LINE_PIXELS 640   // Output pixels per converted line
+
+static hstx_packet_t pool[POOL_SIZE];
+static hstx_packet_t audio_pool[POOL_SIZE];
+static hstx_data_island_t sink[SINK_SIZE];
+static hstx_packet_t packet_sink[SINK_SIZE];
+static audio_sample_t pcm[BLOCK_SAMPLES];
+static uint32_t rng_state = 0x12345678u;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void fill_pool(void)
+{
+    for (int i = 0; i < POOL_SIZE; i++) {
+        hstx_packet_t *p = &pool[i];
+        for (int b = 0; b < 3; b++)
+            p->header[b] = (uint8_t)rng();
+        p->header[3] = tmds_bch(p->header, 3);
+        for (int n = 0; n < 4; n++) {
+            for (int b = 0; b < 7; b++)
+                p->subpacket[n][b] = (uint8_t)rng();
+            p->subpacket[n][7] = tmds_bch(p->subpacket[n], 7);
+        }
+    }
+}
+
+// Audio sample packets with every sample count and B flag position
+static void fill_audio_pool(void)
+{
+    for (int i = 0; i < POOL_SIZE; i++) {
+        audio_sample_t samples[4];
+        for (int n = 0; n < 4; n++) {
+            samples[n].left = (int16_t)rng();
+            samples[n].right = (int16_t)rng();
+        }
+        int count = (i % 8) ? 4 : 1 + (int)(rng() % 4);
+        int frame = (i % 3) ? (int)(rng() % 192) : 189 + (int)(rng() % 4);
+        hstx_packet_set_audio_samples(&audio_pool[i], samples, count, frame % 192);
+    }
+}
+
+static void fill_pcm(void)
+{
+    for (int i = 0; i < BLOCK_SAMPLES; i++) {
+        pcm[i].left = (int16_t)rng();
+        pcm[i].right = (int16_t)rng();
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+}
+
+// One timed round of iters calls, in nanoseconds per call
+static double time_round(void (*fn)(uint32_t), uint32_t iters)
+{
+    uint64_t t0 = now_ns();
+    for (uint32_t i = 0; i < iters; i++)
+        fn(i);
+    return (double)(now_ns() - t0) / iters;
+}
+
+// Min-of-rounds time per call for both implementations, iters calls each in all.
+// The rounds alternate, so clock changes and other load hit both alike, and the
+// minimum drops the rounds that were interrupted.
+static void bench(const char *name, void (*ref)(uint32_t), void (*opt)(uint32_t), uint32_t iters)
+{
+    uint32_t round = iters / ROUNDS ? iters / ROUNDS : 1;
+    double ref_ns = time_round(ref, round); // Warm-up
+    double opt_ns = time_round(opt, round);
+    for (int r = 0; r < ROUNDS; r++) {
+        double ns = time_round(ref, round);
+        if (ns < ref_ns)
+            ref_ns = ns;
+        ns = time_round(opt, round);
+        if (ns < opt_ns)
+            opt_ns = ns;
+    }
+    printf("%-28s reference %7.1f ns  optimised %7.1f ns  speedup %.2fx\n", name, ref_ns, opt_ns, ref_ns / opt_ns);
+}
+
+// ============================================================================
+// Data Island Encoder
+// ============================================================================
+
+static void run_ref_island(uint32_t i)
+{
+    ref_encode_data_island(&sink[i % SINK_SIZE], &pool[i % POOL_SIZE], i & 2, i & 1);
+}
+
+static void run_opt_island(uint32_t i)
+{
+    hstx_encode_data_island(&sink[i % SINK_SIZE], &pool[i % POOL_SIZE], i & 2, i & 1);
+}
+
+static void run_ref_audio_island(uint32_t i)
+{
+    ref_encode_data_island(&sink[i % SINK_SIZE], &audio_pool[i % POOL_SIZE], i & 2, i & 1);
+}
+
+static void run_opt_audio_island(uint32_t i)
+{
+    hstx_encode_data_island(&sink[i % SINK_SIZE], &audio_pool[i % POOL_SIZE], i & 2, i & 1);
+}
+
+static int check_island(const hstx_packet_t *packets)
+{
+    int bad = 0;
+    for (uint32_t i = 0; i < POOL_SIZE * 4; i++) {
+        hstx_data_island_t ref, opt;
+        bool vsync = i & 2, hsync = i & 1;
+        ref_encode_data_island(&ref, &packets[i % POOL_SIZE], vsync, hsync);
+        hstx_encode_data_island(&opt, &packets[i % POOL_SIZE], vsync, hsync);
+
+        hstx_packet_t decoded;
+        tmds_packet_status_t st;
+        hstx_packet_t recovered;
+        bool ok = tmds_decode_island(opt.words, &decoded, &st) &&
+                  memcmp(&decoded, &packets[i % POOL_SIZE], sizeof(decoded)) == 0 &&
+                  hstx_decode_data_island(&recovered, &opt) &&
+                  memcmp(&recovered, &packets[i % POOL_SIZE], sizeof(recovered)) == 0;
+        if (memcmp(&ref, &opt, sizeof(ref)) != 0 || !ok) {
+            if (bad++ < 4)
+                fprintf(stderr, "island mismatch: packet %u vsync %d hsync %d\n", i % POOL_SIZE, vsync, hsync);
+        }
+    }
+    return bad;
+}
+
+// ============================================================================
+// BCH and Audio Sample Packets
+// ============================================================================
+
+static void run_ref_parity(uint32_t i)
+{
+    ref_packet_compute_parity(&pool[i % POOL_SIZE]);
+}
+
+static void run_opt_parity(uint32_t i)
+{
+    hstx_packet_compute_parity(&pool[i % POOL_SIZE]);
+}
+
+static void run_ref_audio_packet(uint32_t i)
+{
+    ref_packet_set_audio_samples(&packet_sink[i % SINK_SIZE], &pcm[i % POOL_SIZE], 4, (int)(i % 192));
+}
+
+static void run_opt_audio_packet(uint32_t i)
+{
+    hstx_packet_set_audio_samples(&packet_sink[i % SINK_SIZE], &pcm[i % POOL_SIZE], 4, (int)(i % 192));
+}
+
+static int check_parity(void)
+{
+    int bad = 0;
+    for (int i = 0; i < POOL_SIZE; i++) {
+        hstx_packet_t ref = pool[i], opt;
+        ref.header[3] = 0;
+        for (int n = 0; n < 4; n++)
+            ref.subpacket[n][7] = 0;
+        opt = ref;
+        ref_packet_compute_parity(&ref);
+        hstx_packet_compute_parity(&opt);
+        if (memcmp(&ref, &opt, sizeof(ref)) != 0 || memcmp(&opt, &pool[i], sizeof(opt)) != 0) {
+            if (bad++ < 4)
+                fprintf(stderr, "parity mismatch: packet %d\n", i);
+        }
+    }
+    return bad;
+}
+
+static int check_audio_packet(void)
+{
+    int bad = 0;
+    for (int frame = 0; frame < 192; frame++) {
+        for (int count = 0; count <= 5; count++) {
+            const audio_sample_t *s = &pcm[(frame * 7 + count) % POOL_SIZE];
+            hstx_packet_t ref, opt;
+            int ref_next = ref_packet_set_audio_samples(&ref, s, count, frame);
+            int opt_next = hstx_packet_set_audio_samples(&opt, s, count, frame);
+
+            hstx_data_island_t island;
+            hstx_packet_t decoded;
+            tmds_packet_status_t st;
+            hstx_encode_data_island(&island, &opt, false, false);
+            bool ok = tmds_decode_island(island.words, &decoded, &st);
+            if (ref_next != opt_next || memcmp(&ref, &opt, sizeof(ref)) != 0 || !ok) {
+                if (bad++ < 4)
+                    fprintf(stderr, "audio packet mismatch: frame %d count %d\n", frame, count);
+            }
+        }
+    }
+    return bad;
+}
+
+// ============================================================================
+// Audio Queue Producer
+// ============================================================================
+
+// One frame of audio through the per-packet loop the example used to run
+static void push_audio_per_packet(void)
+{
+    int frame_count = 0;
+    const audio_sample_t *s = pcm;
+    while (hstx_di_queue_get_level() < 200) {
+        hstx_packet_t *packet = hstx_di_queue_reserve_packet();
+        if (!packet)
+            break;
+        frame_count = hstx_packet_set_audio_samples(packet, s, 4, frame_count);
+        hstx_di_queue_commit();
+        s += 4;
+    }
+}
+
+static void run_ref_audio_block(uint32_t i)
+{
+    (void)i;
+    hstx_di_queue_init();
+    push_audio_per_packet();
+}
+
+static void run_opt_audio_block(uint32_t i)
+{
+    (void)i;
+    hstx_di_queue_init();
+    hstx_di_queue_push_audio(pcm, BLOCK_SAMPLES);
+}
+
+// Drain the queue through the scheduler, as the DMA ISR would
+static int drain_queue(hstx_data_island_t *out, int max)
+{
+    int n = 0;
+    for (int line = 0; n < max && line < 4 * max; line++) {
+        hstx_di_queue_tick();
+        const uint32_t *words = hstx_di_queue_get_audio_packet();
+        if (words)
+            memcpy(out[n++].words, words, sizeof(out[0].words));
+    }
+    return n;
+}
+
+static int check_audio_block(void)
+{
+    static hstx_data_island_t ref[BLOCK_SAMPLES / 4], opt[BLOCK_SAMPLES / 4];
+    hstx_di_queue_init();
+    push_audio_per_packet();
+    int ref_n = drain_queue(ref, BLOCK_SAMPLES / 4);
+
+    hstx_di_queue_init();
+    uint32_t consumed = hstx_di_queue_push_audio(pcm, BLOCK_SAMPLES);
+    int opt_n = drain_queue(opt, BLOCK_SAMPLES / 4);
+
+    if (consumed != BLOCK_SAMPLES || ref_n != BLOCK_SAMPLES / 4 || opt_n != ref_n ||
+        memcmp(ref, opt, sizeof(ref[0]) * (size_t)ref_n) != 0) {
+        fprintf(stderr, "audio block mismatch: consumed %u, islands %d/%d\n", consumed, opt_n, ref_n);
+        return 1;
+    }
+    return 0;
+}
+
+// Islands pushed encoded must come out as the queue would have encoded their packets
+static int check_island_push(void)
+{
+    static hstx_data_island_t pushed[POOL_SIZE / 2];
+    hstx_di_queue_init();
+    for (int i = 0; i < POOL_SIZE / 2; i++) {
+        hstx_data_island_t island;
+        hstx_encode_data_island(&island, &audio_pool[i], i & 2, i & 1);
+        if (!hstx_di_queue_push(&island)) {
+            fprintf(stderr, "hstx_di_queue_push failed: island %d\n", i);
+            return 1;
+        }
+    }
+    int n = drain_queue(pushed, POOL_SIZE / 2);
+    int bad = n != POOL_SIZE / 2;
+    for (int i = 0; i < n; i++) {
+        hstx_data_island_t expected;
+        hstx_encode_data_island(&expected, &audio_pool[i], false, true); // The queue's default sync
+        if (memcmp(&expected, &pushed[i], sizeof(expected)) != 0 && bad++ < 4)
+            fprintf(stderr, "hstx_di_queue_push mismatch: island %d\n", i);
+    }
+    return bad;
+}
+
+// ============================================================================
+// Paletted Line Conversion
+// ============================================================================
+
+typedef void (*palette_kernel_fn)(uint32_t *dst, const uint8_t *src, uint32_t pixels, const video_palette_t *palette);
+
+static const struct {
+    const char *name;
+    palette_kernel_fn fn;
+    uint32_t bpp;
+    uint32_t scale;
+} palette_kernels[] = {
+    {"video_palette_line_8bpp", video_palette_line_8bpp, 8, 1},
+    {"video_palette_line_8bpp_2x", video_palette_line_8bpp_2x, 8, 2},
+    {"video_palette_line_4bpp", video_palette_line_4bpp, 4, 1},
+    {"video_palette_line_4bpp_2x", video_palette_line_4bpp_2x, 4, 2},
+};
+
+#define PALETTE_KERNELS (sizeof(palette_kernels) / sizeof(palette_kernels[0]))
+
+static uint16_t colours[256];
+static video_palette_t palette;
+static uint32_t index_lines[POOL_SIZE][LINE_PIXELS / 4]; // 8 bpp rows of 640; 4 bpp uses half of each
+static uint32_t line_sink[SINK_SIZE][LINE_PIXELS / 2];
+static uint32_t palette_kernel;
+
+static void fill_palette(void)
+{
+    for (int i = 0; i < 256; i++)
+        colours[i] = (uint16_t)rng();
+    video_palette_set(&palette, colours, 256);
+    for (int i = 0; i < POOL_SIZE; i++)
+        for (int w = 0; w < LINE_PIXELS / 4; w++)
+            index_lines[i][w] = rng();
+}
+
+// One pixel at a time through the 16-bit palette
+static void ref_palette_line(uint32_t *dst, const uint8_t *src, uint32_t pixels, uint32_t bpp, uint32_t scale)
+{
+    uint16_t *out = (uint16_t *)dst;
+    for (uint32_t x = 0; x < pixels; x++) {
+        uint32_t index = bpp == 8 ? src[x] : (src[x / 2] >> (4 * (x & 1))) & 0xfu;
+        for (uint32_t s = 0; s < scale; s++)
+            *out++ = colours[index];
+    }
+}
+
+static void run_ref_palette(uint32_t i)
+{
+    uint32_t bpp = palette_kernels[palette_kernel].bpp, scale = palette_kernels[palette_kernel].scale;
+    ref_palette_line(line_sink[i % SINK_SIZE], (const uint8_t *)index_lines[i % POOL_SIZE], LINE_PIXELS / scale, bpp,
+                     scale);
+}
+
+static void run_opt_palette(uint32_t i)
+{
+    palette_kernels[palette_kernel].fn(line_sink[i % SINK_SIZE], (const uint8_t *)index_lines[i % POOL_SIZE],
+                                       LINE_PIXELS / palette_kernels[palette_kernel].scale, &palette);
+}
+
+static int check_palette(uint32_t k)
+{
+    int bad = 0;
+    uint32_t bpp = palette_kernels[k].bpp, scale = palette_kernels[k].scale;
+    for (int i = 0; i < POOL_SIZE; i++) {
+        // Mostly full lines, plus random whole-word lengths
+        uint32_t step = 32 / bpp;
+        uint32_t pixels = (i % 8) ? LINE_PIXELS / scale : step * (1 + rng() % (LINE_PIXELS / scale / step));
+        uint32_t ref[LINE_PIXELS / 2 + 1], opt[LINE_PIXELS / 2 + 1];
+        memset(ref, 0xa5, sizeof(ref));
+        memset(opt, 0xa5, sizeof(opt));
+        ref_palette_line(ref, (const uint8_t *)index_lines[i], pixels, bpp, scale);
+        palette_kernels[k].fn(opt, (const uint8_t *)index_lines[i], pixels, &palette);
+        if (memcmp(ref, opt, sizeof(ref)) != 0) {
+            if (bad++ < 4)
+                fprintf(stderr, "%s mismatch: line %d, %u pixels\n", palette_kernels[k].name, i, pixels);
+        }
+    }
+    return bad;
+}
+
+// Single-colour updates must leave the tables as a full rebuild would
+static int check_palette_set_colour(void)
+{
+    video_palette_t rebuilt;
+    for (int n = 0; n < 64; n++) {
+        uint32_t index = (n % 2) ? rng() % 16 : rng() % 256;
+        colours[index] = (uint16_t)rng();
+        video_palette_set_colour(&palette, index, colours[index]);
+    }
+    video_palette_set(&rebuilt, colours, 256);
+    if (memcmp(&rebuilt, &palette, sizeof(palette)) != 0) {
+        fprintf(stderr, "video_palette_set_colour mismatch\n");
+        return 1;
+    }
+    return 0;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char **argv)
+{
+    uint32_t iters = 200000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') {
+            iters = (uint32_t)strtoul(optarg, NULL, 0);
+        } else {
+            fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+            return 2;
+        }
+    }
+    fill_pool();
+    fill_audio_pool();
+    fill_pcm();
+    fill_palette();
+
+    int bad = 0;
+    int n = check_parity();
+    printf("hstx_packet_compute_parity: %s\n", n ? "MISMATCH" : "bit-exact");
+    bad += n;
+    n = check_audio_packet();
+    printf("hstx_packet_set_audio_samples: %s\n", n ? "MISMATCH" : "bit-exact");
+    bad += n;
+    n = check_audio_block();
+    printf("hstx_di_queue_push_audio: %s\n", n ? "MISMATCH" : "bit-exact");
+    bad += n;
+    n = check_island_push();
+    printf("hstx_di_queue_push: %s\n", n ? "MISMATCH" : "bit-exact");
+    bad += n;
+    n = check_island(pool);
+    printf("hstx_encode_data_island (any packet): %s\n", n ? "MISMATCH" : "bit-exact");
+    bad += n;
+    n = check_island(audio_pool);
+    printf("hstx_encode_data_island (audio): %s\n", n ? "MISMATCH" : "bit-exact");
+    bad += n;
+    for (uint32_t k = 0; k < PALETTE_KERNELS; k++) {
+        n = check_palette(k);
+        printf("%s: %s\n", palette_kernels[k].name, n ? "MISMATCH" : "bit-exact");
+        bad += n;
+    }
+    n = check_palette_set_colour();
+    printf("video_palette_set_colour: %s\n", n ? "MISMATCH" : "bit-exact");
+    bad += n;
+    if (bad)
+        return 1;
+
+    bench("packet parity", run_ref_parity, run_opt_parity, iters);
+    bench("audio sample packet", run_ref_audio_packet, run_opt_audio_packet, iters);
+    bench("queue 800 samples", run_ref_audio_block, run_opt_audio_block, iters / 200);
+    bench("encode island (any packet)", run_ref_island, run_opt_island, iters);
+    bench("encode island (audio)", run_ref_audio_island, run_opt_audio_island, iters);
+    for (palette_kernel = 0; palette_kernel < PALETTE_KERNELS; palette_kernel++) {
+        char name[40];
+        snprintf(name, sizeof(name), "palette %ubpp %ux (%u px)", palette_kernels[palette_kernel].bpp,
+                 palette_kernels[palette_kernel].scale, LINE_PIXELS);
+        bench(name, run_ref_palette, run_opt_palette, iters / 10);
+    }
+    return 0;
+}
@@ -0,0 +1,353 @@
+/**
+ * hdmi_decode - decode and check a symbol stream written by hdmi_emu.
+ *
+ * Usage: hdmi_decode [-V mode] [-P format] [-S frame:to] [-F repeat] [-b WxH] [-p] [-a] [-w audio.wav]
+ *                    [-x frame.ppm] stream.bin
+ *   -V  Video mode the stream was captured in (default 640x480)
+ *   -P  Pixel format the pattern was rendered in (default rgb565)
+ *   -S  The stream switches to this mode or pixel format from this frame on, as
+ *       with hdmi_emu -S. Repeat for more switches, in frame order; dvi and hdmi
+ *       switches are ignored
+ *   -F  Pattern lines were scanned out of a framebuffer, each row on this many lines
+ *   -b  The pattern is W x H letterboxed content, as with hdmi_emu -b
+ *   -p  Check decoded pixels against the host test pattern
+ *   -a  Check decoded PCM against the host test tone
+ *   -w  Write decoded audio as a 48 kHz stereo WAV file
+ *   -x  Write the last decoded frame as a PPM image
+ *
+ * Exits non-zero if any structural, ECC or pattern error was found.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_pattern.h"
+#include "tmds_decode.h"
+
+#define AUDIO_RATE 48000
+#define MAX_SWITCHES 8
+#define USAGE                                                                                                          \
+    "usage: %s [-V mode] [-P format] [-S frame:to] [-F repeat] [-b WxH] [-p] [-a] [-w audio.wav] [-x frame.ppm] "      \
+    "stream.bin\n"
+
+typedef struct {
+    uint64_t packets[VIDEO_OUTPUT_MAX_V_TOTAL_LINES];
+    uint64_t island[VIDEO_OUTPUT_MAX_V_TOTAL_LINES];   // Packet + guard + preamble clocks
+    uint64_t blanking[VIDEO_OUTPUT_MAX_V_TOTAL_LINES]; // All non-video clocks
+    uint32_t max_packets;
+} density_t;
+
+typedef struct {
+    uint32_t frame;           // First frame in the new mode or format
+    const video_mode_t *mode; // NULL for a pixel format switch
+    video_pixel_format_t format;
+} mode_switch_t;
+
+static const video_mode_t *find_mode(const char *name)
+{
+    for (int i = 0; i < VIDEO_MODE_COUNT; i++) {
+        if (strcmp(video_modes[i].name, name) == 0)
+            return &video_modes[i];
+    }
+    return NULL;
+}
+
+// frame:to, where to is a mode name or pixel format. Sets *used unless it is dvi or hdmi.
+static bool parse_switch(mode_switch_t *sw, const char *arg, bool *used)
+{
+    char *end;
+    sw->frame = (uint32_t)strtoul(arg, &end, 0);
+    if (*end != ':' || sw->frame == 0)
+        return false;
+    const char *to = end + 1;
+    sw->mode = find_mode(to);
+    *used = sw->mode || host_pattern_find_format(to, &sw->format);
+    return *used || strcmp(to, "dvi") == 0 || strcmp(to, "hdmi") == 0;
+}
+
+static uint32_t check_pixels(const tmds_decoder_t *dec, video_pixel_format_t format, uint32_t line_repeat,
+                             uint32_t box_width, uint32_t box_height)
+{
+    const video_mode_t *mode = dec->mode;
+    // Doubled modes send each source pixel on two output pixels
+    const uint32_t h_scale = mode->h_active_pixels / video_mode_source_width(mode);
+    // Letterbox content, centred; the rest is border
+    const uint32_t box_w = box_width ? box_width : video_mode_source_width(mode);
+    const uint32_t box_h = box_height ? box_height : mode->v_active_lines;
+    const uint32_t left = (video_mode_source_width(mode) - box_w) / 2;
+    const uint32_t top = (mode->v_active_lines - box_h) / 2;
+    uint32_t bad = 0;
+    for (uint32_t y = 0; y < mode->v_active_lines; y++) {
+        for (uint32_t x = 0; x < mode->h_active_pixels; x++) {
+            uint32_t cx = x / h_scale - left, cy = y - top;
+            uint16_t c = cx < box_w && cy < box_h ? host_pattern_pixel(cx, cy / line_repeat) : HOST_PATTERN_BORDER;
+            uint8_t want[3];
+            host_pattern_expand(host_pattern_pack(c, format), format, want);
+            const uint8_t *p = dec->rgb[(y * mode->h_active_pixels) + x];
+            if (memcmp(p, want, 3) != 0) {
+                if (bad++ < 4)
+                    fprintf(stderr, "pixel %u,%u: got %02x%02x%02x want %02x%02x%02x\n", x, y, p[0], p[1], p[2],
+                            want[0], want[1], want[2]);
+            }
+        }
+    }
+    return bad;
+}
+
+static uint32_t check_audio(const tmds_decoder_t *dec)
+{
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < dec->audio_count; i++) {
+        int16_t l, r;
+        host_pattern_sample(i, &l, &r);
+        const tmds_audio_sample_t *s = &dec->audio[i];
+        if (s->left != l || s->right != r || s->b_flag != (i % 192 == 0)) {
+            if (bad++ < 4)
+                fprintf(stderr, "sample %u: got %d/%d b=%d want %d/%d\n", i, s->left, s->right, s->b_flag, l, r);
+        }
+    }
+    return bad;
+}
+
+static void put_le(FILE *f, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        fputc((int)((v >> (8 * i)) & 0xffu), f);
+}
+
+static int write_wav(const tmds_decoder_t *dec, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    uint32_t data_bytes = dec->audio_count * 4u;
+    fputs("RIFF", f);
+    put_le(f, 36 + data_bytes, 4);
+    fputs("WAVEfmt ", f);
+    put_le(f, 16, 4);
+    put_le(f, 1, 2);
+    put_le(f, 2, 2);
+    put_le(f, AUDIO_RATE, 4);
+    put_le(f, AUDIO_RATE * 4, 4);
+    put_le(f, 4, 2);
+    put_le(f, 16, 2);
+    fputs("data", f);
+    put_le(f, data_bytes, 4);
+    for (uint32_t i = 0; i < dec->audio_count; i++) {
+        put_le(f, (uint16_t)dec->audio[i].left, 2);
+        put_le(f, (uint16_t)dec->audio[i].right, 2);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int write_ppm(const tmds_decoder_t *dec, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", dec->mode->h_active_pixels, dec->mode->v_active_lines);
+    fwrite(dec->rgb, 3, (size_t)dec->mode->h_active_pixels * dec->mode->v_active_lines, f);
+    fclose(f);
+    return 0;
+}
+
+static void accumulate_density(density_t *d, const tmds_decoder_t *dec)
+{
+    for (uint32_t y = 0; y < video_mode_v_total(dec->mode); y++) {
+        const tmds_line_info_t *li = &dec->line[y];
+        d->packets[y] += li->packets;
+        d->island[y] += li->island + li->guard + li->preamble;
+        d->blanking[y] += video_mode_h_total(dec->mode) - li->video;
+        if (li->packets > d->max_packets)
+            d->max_packets = li->packets;
+    }
+}
+
+static void print_report(const tmds_decoder_t *dec, const density_t *d)
+{
+    const video_mode_t *mode = dec->mode;
+    const uint32_t v_total = video_mode_v_total(mode);
+
+    printf("frames %u  errors %u  bch %u  parity %u  checksum %u\n", dec->frames, dec->error_count, dec->bch_errors,
+           dec->parity_errors, dec->checksum_errors);
+    for (uint32_t i = 0; i < dec->error_count && i < TMDS_DECODE_MAX_ERRORS; i++)
+        printf("  error: %s\n", dec->errors[i]);
+
+    printf("packets  null %u  acr %u  audio %u  avi %u  audio-if %u\n", dec->packets_by_type[TMDS_PACKET_NULL],
+           dec->packets_by_type[TMDS_PACKET_ACR], dec->packets_by_type[TMDS_PACKET_AUDIO_SAMPLE],
+           dec->packets_by_type[TMDS_PACKET_AVI_INFOFRAME], dec->packets_by_type[TMDS_PACKET_AUDIO_INFOFRAME]);
+    printf("acr N=%u CTS=%u  avi vic %u\n", dec->acr_n, dec->acr_cts, dec->avi_vic);
+
+    // Island density and blanking use, split at the first active line
+    const uint32_t act = v_total - mode->v_active_lines;
+    uint64_t pk[2] = {0}, isl[2] = {0}, blank[2] = {0}, lines_with[2] = {0};
+    for (uint32_t y = 0; y < v_total; y++) {
+        int r = y >= act;
+        pk[r] += d->packets[y];
+        isl[r] += d->island[y];
+        blank[r] += d->blanking[y];
+        lines_with[r] += d->packets[y] ? 1 : 0;
+    }
+    const char *names[2] = {"vblank", "active"};
+    const uint32_t nlines[2] = {act, mode->v_active_lines};
+    for (int r = 0; r < 2; r++) {
+        printf("%-7s packets/line %.3f  lines with islands %llu/%u  blanking used by islands %.1f%%\n", names[r],
+               (double)pk[r] / ((double)nlines[r] * dec->frames), (unsigned long long)lines_with[r], nlines[r],
+               blank[r] ? 100.0 * (double)isl[r] / (double)blank[r] : 0.0);
+    }
+    printf("max packets on one line %u\n", d->max_packets);
+
+    // Audio: arrival of each sample against its ideal presentation time
+    printf("audio samples %u (last frame %u)\n", dec->audio_count, dec->audio_frame_samples);
+    if (dec->audio_count) {
+        double lo = 0, hi = 0;
+        for (uint32_t i = 0; i < dec->audio_count; i++) {
+            double off = (dec->audio[i].seconds - ((double)i / AUDIO_RATE)) * 1e6;
+            if (i == 0 || off < lo)
+                lo = off;
+            if (i == 0 || off > hi)
+                hi = off;
+        }
+        printf("audio jitter %.2f us (offset %.2f..%.2f us)\n", hi - lo, lo, hi);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool check_pix = false, check_pcm = false;
+    const char *wav_path = NULL, *ppm_path = NULL;
+    const video_mode_t *mode = &video_modes[VIDEO_MODE_640X480P60];
+    mode_switch_t switches[MAX_SWITCHES];
+    uint32_t switch_count = 0;
+    uint32_t line_repeat = 1;
+    uint32_t box_width = 0, box_height = 0;
+    video_pixel_format_t format = VIDEO_PIXEL_FORMAT_RGB565;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "V:P:S:F:b:paw:x:")) != -1) {
+        switch (opt) {
+            case 'V':
+                mode = find_mode(optarg);
+                if (!mode) {
+                    fprintf(stderr, "%s: unknown mode %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'P':
+                if (!host_pattern_find_format(optarg, &format)) {
+                    fprintf(stderr, "%s: unknown pixel format %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'S': {
+                bool used;
+                if (switch_count == MAX_SWITCHES || !parse_switch(&switches[switch_count], optarg, &used)) {
+                    fprintf(stderr, "%s: bad switch %s\n", argv[0], optarg);
+                    return 2;
+                }
+                if (used)
+                    switch_count++;
+                break;
+            }
+            case 'F':
+                line_repeat = (uint32_t)strtoul(optarg, NULL, 0);
+                if (line_repeat == 0) {
+                    fprintf(stderr, "%s: bad repeat %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'b':
+                if (sscanf(optarg, "%ux%u", &box_width, &box_height) != 2) {
+                    fprintf(stderr, "%s: bad letterbox %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'p':
+                check_pix = true;
+                break;
+            case 'a':
+                check_pcm = true;
+                break;
+            case 'w':
+                wav_path = optarg;
+                break;
+            case 'x':
+                ppm_path = optarg;
+                break;
+            default:
+                fprintf(stderr, USAGE, argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 2;
+    }
+
+    FILE *in = fopen(argv[optind], "rb");
+    if (!in) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    tmds_decoder_t *dec = malloc(sizeof(*dec));
+    density_t *density = calloc(1, sizeof(*density));
+    size_t frame_symbols = (size_t)video_mode_h_total(mode) * video_mode_v_total(mode);
+    uint32_t *frame = malloc(frame_symbols * sizeof(uint32_t));
+    if (!dec || !density || !frame || tmds_decoder_init(dec, mode) != 0)
+        return 1;
+
+    uint32_t pixel_errors = 0;
+    uint32_t next_switch = 0;
+    while (true) {
+        while (next_switch < switch_count && switches[next_switch].frame == dec->frames) {
+            const mode_switch_t *sw = &switches[next_switch++];
+            if (!sw->mode) {
+                format = sw->format;
+                continue;
+            }
+            mode = sw->mode;
+            frame_symbols = (size_t)video_mode_h_total(mode) * video_mode_v_total(mode);
+            free(frame);
+            frame = malloc(frame_symbols * sizeof(uint32_t));
+            if (!frame || tmds_decoder_set_mode(dec, mode) != 0)
+                return 1;
+        }
+        if (fread(frame, sizeof(uint32_t), frame_symbols, in) != frame_symbols)
+            break;
+        tmds_decode_frame(dec, frame);
+        accumulate_density(density, dec);
+        if (check_pix)
+            pixel_errors += check_pixels(dec, format, line_repeat, box_width, box_height);
+    }
+    fclose(in);
+
+    uint32_t audio_errors = check_pcm ? check_audio(dec) : 0;
+    print_report(dec, density);
+    if (check_pix)
+        printf("pixel mismatches %u\n", pixel_errors);
+    if (check_pcm)
+        printf("audio mismatches %u\n", audio_errors);
+
+    int rc = 0;
+    if (wav_path && write_wav(dec, wav_path) != 0)
+        rc = 1;
+    if (ppm_path && write_ppm(dec, ppm_path) != 0)
+        rc = 1;
+    if (dec->frames == 0 || dec->error_count || pixel_errors || audio_errors || dec->parity_errors ||
+        dec->checksum_errors)
+        rc = 1;
+
+    tmds_decoder_free(dec);
+    free(dec);
+    free(density);
+    free(frame);
+    return rc;
+}
@@ -0,0 +1,725 @@
+/**
+ * hdmi_emu - run pico_hdmi on the host and capture its HSTX output.
+ *
+ * Usage: hdmi_emu [-V mode] [-P format] [-S frame:to] [-F repeat] [-D buffers] [-R every] [-C repeat] [-s]
+ *                 [-w] [-b WxH] [-n frames] [-o stream.bin] [-c lines.csv] [-d] [-m] [-f] [-r ppm] [-L us] [-q]
+ *   -V  Video mode, by name (default 640x480)
+ *   -P  Pixel format: rgb565 (default), rgb555, rgb332 or y4
+ *   -S  Switch to a mode, pixel format, or to dvi or hdmi, from this frame on,
+ *       while running. Repeat for more switches, in frame order
+ *   -F  Scan the pattern out of a framebuffer, each row on this many lines,
+ *       instead of rendering it from the scanline callback
+ *   -D  Present the framebuffer once a frame from the producer, cycling through
+ *       this many copies (2 or 3; implies -F 1 unless given). With 2 the producer
+ *       waits for the last present to be taken, with 3 it never does
+ *   -R  Render the pattern ahead into the line ring from the producer, one line
+ *       every this many producer calls (two per active line), instead of from
+ *       the scanline callback. Above 2 it falls behind and lines go out black
+ *   -C  Draw the pattern from the cached scanline callback, each line on this many
+ *       lines: the others repeat the group's first line from the line cache
+ *   -s  Send the pattern from the span callback: solid runs and raw segments
+ *   -w  Send the pattern from the window callback: four windows read in place,
+ *       alternately from two copies of the pattern framebuffer
+ *   -b  Letterbox: the pattern as W x H content centred in the mode, in a border
+ *   -n  Frames to emit (default 2)
+ *   -o  Write the symbol stream (little-endian uint32 per pixel clock)
+ *   -c  Write per-scanline ISR statistics as CSV
+ *   -d  DVI mode (no data islands)
+ *   -m  Mute: do not feed the audio queue
+ *   -f  Feed audio through the library PCM FIFO instead of the queue
+ *   -r  Real-time source: 1 ms blocks from a 48 kHz clock offset by ppm (implies -f)
+ *   -L  Low-latency FIFO mode with this buffering target (implies -f)
+ *   -q  No summary on stdout
+ */
+
+#include "pico_hdmi/hstx_audio_fifo.h"
+#include "pico_hdmi/hstx_data_island_queue.h"
+#include "pico_hdmi/hstx_packet.h"
+#include "pico_hdmi/video_output.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_pattern.h"
+#include "hstx_emu.h"
+
+#define AUDIO_QUEUE_TARGET 200
+#define AUDIO_BLOCK_SAMPLES 800
+#define SOURCE_BLOCK_SAMPLES 48 // 1 ms
+#define SETTLE_FRAMES 180       // Ignore buffering stats while the rate loop settles
+#define MAX_SWITCHES 8
+#define MAX_PRESENT_BUFFERS 3
+#define USAGE                                                                                                          \
+    "usage: %s [-V mode] [-P format] [-S frame:to] [-F repeat] [-D buffers] [-R every] [-C repeat] [-s] [-w] "         \
+    "[-b WxH] [-n frames] [-o stream.bin] [-c lines.csv] [-d] [-m] [-f] [-r ppm] [-L us] [-q]\n"
+
+typedef struct {
+    uint32_t frame;           // First frame output after the switch
+    const video_mode_t *mode; // NULL for a DVI/HDMI or pixel format switch
+    bool dvi;
+    bool pixel_format;
+    video_pixel_format_t format;
+} mode_switch_t;
+
+typedef struct {
+    FILE *out;
+    bool audio;
+    bool fifo;
+    uint32_t sample_index;
+
+    // Real-time source
+    bool realtime;
+    double source_ppm;
+    const hstx_emu_stats_t *stats;
+    uint32_t overflows;
+    uint32_t buffered_min, buffered_max;
+    uint64_t buffered_sum, buffered_count;
+
+    // Framebuffer scan-out: one pattern framebuffer per pixel format, made on first use
+    uint32_t line_repeat;
+    uint32_t *framebuffers[VIDEO_PIXEL_FORMAT_COUNT];
+
+    // Presenting: framebuffers[format] and present_copies[format] are the buffers
+    // cycled through, once per frame
+    uint32_t present_buffers;
+    uint32_t *present_copies[VIDEO_PIXEL_FORMAT_COUNT][MAX_PRESENT_BUFFERS - 1];
+    uint32_t presented_frame;
+    uint32_t presents;
+    uint32_t present_waits; // Frames the producer skipped, both buffers in use
+    uint32_t released;
+
+    // Window callback: the second copy, so neighbouring windows come from different buffers
+    bool windows;
+    uint32_t *window_copies[VIDEO_PIXEL_FORMAT_COUNT];
+
+    // Cached scanline callback: draw one pattern line per cache_repeat lines
+    uint32_t cache_repeat;
+
+    // Letterbox content size, 0x0 for none
+    uint32_t letterbox_width;
+    uint32_t letterbox_height;
+
+    // Line ring: render one line every ring_every producer calls
+    uint32_t ring_every;
+    uint32_t ring_calls;
+
+    // Switches while running. Mode and DVI/HDMI switches are made by the producer,
+    // pixel format switches from the vsync callback.
+    mode_switch_t switches[MAX_SWITCHES];
+    uint32_t switch_count;
+    uint32_t next_switch;
+    uint32_t next_format_switch;
+    bool switch_failed;
+} emu_app_t;
+
+// For the vsync and pattern callbacks, which take no context
+static emu_app_t *vsync_app;
+
+// ============================================================================
+// Sources
+// ============================================================================
+
+// Source pixels per pattern line: the letterbox content, or the mode's width
+static uint32_t pattern_width(void)
+{
+    if (vsync_app->letterbox_width)
+        return vsync_app->letterbox_width;
+    return video_mode_source_width(video_output_get_mode());
+}
+
+static void pattern_scanline(uint32_t v_scanline, uint32_t active_line, uint32_t *dst)
+{
+    (void)v_scanline;
+    host_pattern_line(dst, active_line, pattern_width(), video_output_get_pixel_format());
+}
+
+static uint32_t packed_pixel(const uint32_t *line, uint32_t x, uint32_t bpp)
+{
+    return (line[x * bpp / 32] >> (x * bpp % 32)) & (0xffffffffu >> (32 - bpp));
+}
+
+// Whether the unit pixels from x are all one colour
+static bool unit_solid(const uint32_t *line, uint32_t x, uint32_t unit, uint32_t bpp)
+{
+    for (uint32_t i = x + 1; i < x + unit; i++) {
+        if (packed_pixel(line, i, bpp) != packed_pixel(line, x, bpp))
+            return false;
+    }
+    return true;
+}
+
+// Pattern line active_line / repeat, drawn on the first line of each group and
+// repeated from the cache on the rest
+static uint32_t pattern_cached(uint32_t v_scanline, uint32_t active_line, uint32_t *dst)
+{
+    const uint32_t first = active_line - active_line % vsync_app->cache_repeat;
+    if (first != active_line)
+        return first;
+    pattern_scanline(v_scanline, active_line / vsync_app->cache_repeat, dst);
+    return active_line;
+}
+
+// The pattern line split into runs of whole words of one colour, and raw segments between them
+static uint32_t pattern_spans(uint32_t v_scanline, uint32_t active_line, video_span_t *spans)
+{
+    static uint32_t line[VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS / 2];
+    (void)v_scanline;
+    const video_mode_t *mode = video_output_get_mode();
+    const video_pixel_format_t format = video_output_get_pixel_format();
+    const uint32_t width = pattern_width();
+    const uint32_t bpp = video_pixel_format_bpp(format);
+    const uint32_t unit = mode->h_pixel_double ? 1 : 32 / bpp;
+    host_pattern_line(line, active_line, width, format);
+
+    uint32_t count = 0;
+    for (uint32_t x = 0; x < width; count++) {
+        uint32_t c = packed_pixel(line, x, bpp);
+        bool solid = unit_solid(line, x, unit, bpp);
+        uint32_t end = x + unit;
+        if (count == VIDEO_OUTPUT_MAX_SPANS - 1) {
+            // Out of spans: the rest of the line raw
+            solid = false;
+            end = width;
+        }
+        if (solid) {
+            while (end < width && unit_solid(line, end, unit, bpp) && packed_pixel(line, end, bpp) == c)
+                end += unit;
+        } else {
+            while (end < width && !unit_solid(line, end, unit, bpp))
+                end += unit;
+        }
+        spans[count].pixels = solid ? NULL : (const uint8_t *)line + (x * bpp / 8);
+        spans[count].colour = c;
+        spans[count].length = end - x;
+        x = end;
+    }
+    return count;
+}
+
+// Rows are sized for the widest mode at 16 bpp
+#define FB_STRIDE_WORDS (VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS / 2)
+
+// The pattern as a framebuffer wide and tall enough for any mode: row y is pattern line y
+static uint32_t *pattern_framebuffer(video_pixel_format_t format)
+{
+    uint32_t *fb = malloc(sizeof(uint32_t) * FB_STRIDE_WORDS * VIDEO_OUTPUT_MAX_V_TOTAL_LINES);
+    if (!fb)
+        return NULL;
+    for (uint32_t y = 0; y < VIDEO_OUTPUT_MAX_V_TOTAL_LINES; y++)
+        host_pattern_line(&fb[y * FB_STRIDE_WORDS], y, VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS, format);
+    return fb;
+}
+
+// The pattern line as four windows, alternately from the framebuffer and its copy
+static uint32_t pattern_windows(uint32_t v_scanline, uint32_t active_line, video_window_t *windows)
+{
+    (void)v_scanline;
+    const video_pixel_format_t format = video_output_get_pixel_format();
+    const uint32_t width = pattern_width();
+    const uint32_t bpp = video_pixel_format_bpp(format);
+    // Multiples of 8 pixels are whole words in every format
+    const uint32_t widths[4] = {64, (width / 2 - 64) & ~7u, (width / 4) & ~7u, 0};
+    const uint32_t *sources[2] = {vsync_app->framebuffers[format], vsync_app->window_copies[format]};
+
+    uint32_t x = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        const uint32_t *row = &sources[i & 1][active_line * FB_STRIDE_WORDS];
+        windows[i].pixels = (const uint8_t *)row + (x * bpp / 8);
+        windows[i].width = i == 3 ? width - x : widths[i];
+        x += windows[i].width;
+    }
+    return 4;
+}
+
+// Select a pixel format, with the letterbox border in it, and a framebuffer when
+// scanning out or composing windows
+static bool select_format(emu_app_t *app, video_pixel_format_t format)
+{
+    if (!video_output_set_pixel_format(format) ||
+        !video_output_set_letterbox(app->letterbox_width, app->letterbox_height,
+                                    host_pattern_pack(HOST_PATTERN_BORDER, format)))
+        return false;
+    if (app->windows && !app->window_copies[format]) {
+        app->window_copies[format] = pattern_framebuffer(format);
+        if (!app->window_copies[format])
+            return false;
+    }
+    for (uint32_t i = 0; i + 1 < app->present_buffers; i++) {
+        if (!app->present_copies[format][i])
+            app->present_copies[format][i] = pattern_framebuffer(format);
+        if (!app->present_copies[format][i])
+            return false;
+    }
+    if (!app->line_repeat && !app->windows)
+        return true;
+    if (!app->framebuffers[format])
+        app->framebuffers[format] = pattern_framebuffer(format);
+    if (!app->line_repeat)
+        return app->framebuffers[format] != NULL;
+    return app->framebuffers[format] &&
+           video_output_set_framebuffer(app->framebuffers[format], FB_STRIDE_WORDS * sizeof(uint32_t),
+                                        app->line_repeat);
+}
+
+// A renderer on the other core, keeping the line ring ahead of the beam
+static void render_ring(emu_app_t *app)
+{
+    if (!app->ring_every || ++app->ring_calls % app->ring_every)
+        return;
+    uint32_t line;
+    uint32_t *dst = video_output_line_ring_acquire(&line);
+    if (!dst)
+        return;
+    host_pattern_line(dst, line, pattern_width(), video_output_get_pixel_format());
+    video_output_line_ring_commit();
+}
+
+static const uint32_t *present_buffer(const emu_app_t *app, video_pixel_format_t format, uint32_t i)
+{
+    return i ? app->present_copies[format][i - 1] : app->framebuffers[format];
+}
+
+// A renderer presenting a new frame once a frame, into a buffer the DMA is not
+// reading and that is not already waiting to be shown
+static void present_frame(emu_app_t *app)
+{
+    if (!app->present_buffers || app->stats->frames == app->presented_frame)
+        return;
+    const video_pixel_format_t format = video_output_get_pixel_format();
+    const void *front = video_output_get_front_buffer();
+    const void *pending = video_output_get_pending_buffer();
+    if (app->present_buffers == 2 && pending) {
+        app->present_waits++;
+        app->presented_frame = app->stats->frames;
+        return;
+    }
+    for (uint32_t i = 0; i < app->present_buffers; i++) {
+        const uint32_t *buf = present_buffer(app, format, i);
+        if (buf != front && buf != pending) {
+            video_output_present(buf);
+            app->presents++;
+            break;
+        }
+    }
+    app->presented_frame = app->stats->frames;
+}
+
+static void count_released(const void *released)
+{
+    (void)released;
+    vsync_app->released++;
+}
+
+// A source with its own sample clock, delivering fixed blocks as they fill
+static void feed_realtime(emu_app_t *app)
+{
+    double t = hstx_emu_seconds();
+    uint64_t due = (uint64_t)(t * 48000.0 * (1.0 + (app->source_ppm * 1e-6)));
+    while (due >= (uint64_t)app->sample_index + SOURCE_BLOCK_SAMPLES) {
+        audio_sample_t block[SOURCE_BLOCK_SAMPLES];
+        for (uint32_t i = 0; i < SOURCE_BLOCK_SAMPLES; i++)
+            host_pattern_sample(app->sample_index + i, &block[i].left, &block[i].right);
+        if (hstx_audio_fifo_write(block, SOURCE_BLOCK_SAMPLES) < SOURCE_BLOCK_SAMPLES)
+            app->overflows++;
+        app->sample_index += SOURCE_BLOCK_SAMPLES;
+    }
+
+    if (app->stats->frames >= SETTLE_FRAMES) {
+        uint32_t buffered = hstx_audio_fifo_get_level() + (hstx_di_queue_get_level() * 4);
+        if (app->buffered_count == 0 || buffered < app->buffered_min)
+            app->buffered_min = buffered;
+        if (buffered > app->buffered_max)
+            app->buffered_max = buffered;
+        app->buffered_sum += buffered;
+        app->buffered_count++;
+    }
+}
+
+// Same top-up as examples/bouncing_box generate_audio()
+static void feed_audio(emu_app_t *app)
+{
+    if (!app->audio)
+        return;
+    if (app->realtime) {
+        feed_realtime(app);
+        return;
+    }
+
+    uint32_t count;
+    if (app->fifo) {
+        count = hstx_audio_fifo_get_free();
+    } else {
+        uint32_t level = hstx_di_queue_get_level();
+        count = level < AUDIO_QUEUE_TARGET ? (AUDIO_QUEUE_TARGET - level) * 4 : 0;
+    }
+    if (count > AUDIO_BLOCK_SAMPLES)
+        count = AUDIO_BLOCK_SAMPLES;
+    if (count == 0)
+        return;
+
+    audio_sample_t block[AUDIO_BLOCK_SAMPLES];
+    for (uint32_t i = 0; i < count; i++)
+        host_pattern_sample(app->sample_index + i, &block[i].left, &block[i].right);
+    app->sample_index += app->fifo ? hstx_audio_fifo_write(block, count) : hstx_di_queue_push_audio(block, count);
+}
+
+// Requests each switch during the frame before it, so the ISR takes it at that
+// frame's line 0. Never waits: a pending mode switch holds back the next one.
+static void apply_switches(emu_app_t *app)
+{
+    while (app->next_switch < app->switch_count) {
+        const mode_switch_t *sw = &app->switches[app->next_switch];
+        if (sw->pixel_format) {
+            app->next_switch++;
+            continue;
+        }
+        if (app->stats->frames + 1 < sw->frame)
+            return;
+        if (sw->mode) {
+            if (video_output_switch_pending())
+                return;
+            if (!video_output_set_mode(sw->mode))
+                app->switch_failed = true;
+        } else {
+            video_output_set_dvi_mode(sw->dvi);
+        }
+        app->next_switch++;
+    }
+}
+
+// Runs before the frame's first active line, where the ISR latches format and framebuffer
+static void apply_format_switches(void)
+{
+    emu_app_t *app = vsync_app;
+    while (app->next_format_switch < app->switch_count) {
+        const mode_switch_t *sw = &app->switches[app->next_format_switch];
+        if (!sw->pixel_format) {
+            app->next_format_switch++;
+            continue;
+        }
+        if (app->stats->frames < sw->frame)
+            return;
+        if (!select_format(app, sw->format))
+            app->switch_failed = true;
+        app->next_format_switch++;
+    }
+}
+
+static void produce(void *ctx)
+{
+    emu_app_t *app = ctx;
+    apply_switches(app);
+    render_ring(app);
+    present_frame(app);
+    feed_audio(app);
+}
+
+static void write_frame(const uint32_t *symbols, uint32_t count, uint32_t frame, void *ctx)
+{
+    (void)frame;
+    emu_app_t *app = ctx;
+    if (app->out)
+        fwrite(symbols, sizeof(uint32_t), count, app->out);
+}
+
+// ============================================================================
+// Reporting
+// ============================================================================
+
+static void print_region(const hstx_emu_stats_t *st, const char *name, uint32_t first, uint32_t last)
+{
+    uint64_t irqs = 0, ns = 0, max_ns = 0, words = 0, bytes = 0, rp_ns = 0, rp_max_ns = 0;
+    uint32_t worst = first;
+    for (uint32_t l = first; l <= last; l++) {
+        irqs += st->line[l].irqs;
+        ns += st->line[l].total_ns;
+        words += st->line[l].dma_words;
+        bytes += st->line[l].dma_bytes;
+        rp_ns += st->line[l].reprogram_total_ns;
+        if (st->line[l].max_ns > max_ns) {
+            max_ns = st->line[l].max_ns;
+            worst = l;
+        }
+        if (st->line[l].reprogram_max_ns > rp_max_ns)
+            rp_max_ns = st->line[l].reprogram_max_ns;
+    }
+    printf("  %-12s lines %3u-%3u  irq/frame %6.1f  avg %6.0f ns  max %7llu ns (line %3u)  "
+           "to reprogram avg %6.0f max %7llu ns  dma words/frame %8.1f  bytes/frame %9.1f\n",
+           name, first, last, (double)irqs / st->frames, irqs ? (double)ns / (double)irqs : 0.0,
+           (unsigned long long)max_ns, worst, irqs ? (double)rp_ns / (double)irqs : 0.0,
+           (unsigned long long)rp_max_ns, (double)words / st->frames, (double)bytes / st->frames);
+}
+
+static void print_summary(const hstx_emu_stats_t *st)
+{
+    const video_mode_t *mode = video_output_get_mode();
+    const uint32_t vs = mode->v_front_porch;
+    const uint32_t bp = mode->v_front_porch + mode->v_sync_width;
+    const uint32_t act = video_mode_v_total(mode) - mode->v_active_lines;
+
+    printf("frames %u  symbols %llu  irqs %llu  bad commands %u\n", st->frames, (unsigned long long)st->symbols,
+           (unsigned long long)st->irqs, st->bad_commands);
+    print_region(st, "front porch", 0, vs - 1);
+    print_region(st, "vsync", vs, bp - 1);
+    print_region(st, "back porch", bp, act - 1);
+    print_region(st, "active", act, video_mode_v_total(mode) - 1);
+}
+
+static void print_audio_source(const emu_app_t *app, uint32_t target_us)
+{
+    const double ms_per_sample = 1000.0 / 48000.0;
+    printf("source %+.0f ppm  low-latency target %u us  rate adjust %+d ppm  underruns %u  overflows %u\n",
+           app->source_ppm, target_us, hstx_audio_fifo_get_rate_adjust_ppm(), hstx_di_queue_get_underruns(),
+           app->overflows);
+    if (app->buffered_count)
+        printf("buffered after %u frames  min %.2f ms  avg %.2f ms  max %.2f ms\n", SETTLE_FRAMES,
+               app->buffered_min * ms_per_sample,
+               (double)app->buffered_sum / (double)app->buffered_count * ms_per_sample,
+               app->buffered_max * ms_per_sample);
+}
+
+static int write_csv(const hstx_emu_stats_t *st, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "line,irqs,dma_words,total_ns,max_ns,reprogram_total_ns,reprogram_max_ns,dma_bytes\n");
+    for (uint32_t l = 0; l < video_mode_v_total(video_output_get_mode()); l++) {
+        const hstx_emu_line_stats_t *ls = &st->line[l];
+        fprintf(f, "%u,%u,%u,%llu,%llu,%llu,%llu,%u\n", l, ls->irqs, ls->dma_words,
+                (unsigned long long)ls->total_ns, (unsigned long long)ls->max_ns,
+                (unsigned long long)ls->reprogram_total_ns, (unsigned long long)ls->reprogram_max_ns, ls->dma_bytes);
+    }
+    fclose(f);
+    return 0;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+static const video_mode_t *find_mode(const char *name)
+{
+    for (int i = 0; i < VIDEO_MODE_COUNT; i++) {
+        if (strcmp(video_modes[i].name, name) == 0)
+            return &video_modes[i];
+    }
+    return NULL;
+}
+
+// frame:to, where to is a mode name, a pixel format, dvi or hdmi
+static bool parse_switch(emu_app_t *app, const char *arg)
+{
+    char *end;
+    uint32_t frame = (uint32_t)strtoul(arg, &end, 0);
+    if (*end != ':' || frame == 0 || app->switch_count == MAX_SWITCHES)
+        return false;
+
+    mode_switch_t *sw = &app->switches[app->switch_count];
+    const char *to = end + 1;
+    sw->frame = frame;
+    sw->mode = NULL;
+    sw->dvi = strcmp(to, "dvi") == 0;
+    sw->pixel_format = host_pattern_find_format(to, &sw->format);
+    if (!sw->dvi && !sw->pixel_format && strcmp(to, "hdmi") != 0) {
+        sw->mode = find_mode(to);
+        if (!sw->mode)
+            return false;
+    }
+    app->switch_count++;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    emu_app_t app = {.audio = true};
+    hstx_emu_config_t cfg = {.frames = 2, .producer = produce, .frame_done = write_frame, .ctx = &app};
+    const char *out_path = NULL;
+    const char *csv_path = NULL;
+    bool dvi = false;
+    bool quiet = false;
+    bool spans = false;
+    uint32_t target_us = 0;
+    const video_mode_t *mode = &video_modes[VIDEO_MODE_640X480P60];
+    video_pixel_format_t format = VIDEO_PIXEL_FORMAT_RGB565;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "V:P:S:F:D:R:C:swb:n:o:c:dmfr:L:q")) != -1) {
+        switch (opt) {
+            case 'V':
+                mode = find_mode(optarg);
+                if (!mode) {
+                    fprintf(stderr, "%s: unknown mode %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'P':
+                if (!host_pattern_find_format(optarg, &format)) {
+                    fprintf(stderr, "%s: unknown pixel format %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'S':
+                if (!parse_switch(&app, optarg)) {
+                    fprintf(stderr, "%s: bad switch %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'F':
+                app.line_repeat = (uint32_t)strtoul(optarg, NULL, 0);
+                if (app.line_repeat == 0) {
+                    fprintf(stderr, "%s: bad repeat %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'D':
+                app.present_buffers = (uint32_t)strtoul(optarg, NULL, 0);
+                if (app.present_buffers < 2 || app.present_buffers > MAX_PRESENT_BUFFERS) {
+                    fprintf(stderr, "%s: bad buffer count %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'R':
+                app.ring_every = (uint32_t)strtoul(optarg, NULL, 0);
+                if (app.ring_every == 0) {
+                    fprintf(stderr, "%s: bad line ring rate %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'C':
+                app.cache_repeat = (uint32_t)strtoul(optarg, NULL, 0);
+                if (app.cache_repeat == 0) {
+                    fprintf(stderr, "%s: bad repeat %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 's':
+                spans = true;
+                break;
+            case 'w':
+                app.windows = true;
+                break;
+            case 'b':
+                if (sscanf(optarg, "%ux%u", &app.letterbox_width, &app.letterbox_height) != 2) {
+                    fprintf(stderr, "%s: bad letterbox %s\n", argv[0], optarg);
+                    return 2;
+                }
+                break;
+            case 'n':
+                cfg.frames = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            case 'c':
+                csv_path = optarg;
+                break;
+            case 'd':
+                dvi = true;
+                break;
+            case 'm':
+                app.audio = false;
+                break;
+            case 'f':
+                app.fifo = true;
+                break;
+            case 'r':
+                app.realtime = app.fifo = true;
+                app.source_ppm = strtod(optarg, NULL);
+                break;
+            case 'L':
+                app.realtime = app.fifo = true;
+                target_us = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                fprintf(stderr, USAGE, argv[0]);
+                return 2;
+        }
+    }
+    if (cfg.frames == 0)
+        cfg.frames = 1;
+    if (app.present_buffers && !app.line_repeat)
+        app.line_repeat = 1;
+
+    if (out_path) {
+        app.out = fopen(out_path, "wb");
+        if (!app.out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    hstx_emu_stats_t *stats = calloc(1, sizeof(*stats));
+    if (!stats)
+        return 1;
+    app.stats = stats;
+
+    hstx_di_queue_init();
+    hstx_audio_fifo_init();
+    hstx_audio_fifo_set_low_latency(target_us);
+    if (!video_output_set_mode(mode)) {
+        fprintf(stderr, "%s: mode %s does not fit\n", argv[0], mode->name);
+        return 1;
+    }
+    video_output_init(mode->h_active_pixels, mode->v_active_lines);
+    video_output_set_scanline_callback(pattern_scanline);
+    if (app.cache_repeat)
+        video_output_set_cached_scanline_callback(pattern_cached);
+    if (spans)
+        video_output_set_span_callback(pattern_spans);
+    if (app.windows)
+        video_output_set_window_callback(pattern_windows);
+    vsync_app = &app;
+    video_output_set_vsync_callback(apply_format_switches);
+    if (app.present_buffers)
+        video_output_set_present_callback(count_released);
+    if (!select_format(&app, format)) {
+        fprintf(stderr, "%s: pixel format %s does not fit mode %s\n", argv[0], host_pattern_format_names[format],
+                mode->name);
+        return 1;
+    }
+    video_output_set_dvi_mode(dvi);
+    video_output_set_line_ring(app.ring_every != 0);
+    feed_audio(&app);
+
+    int rc = hstx_emu_run(&cfg, stats);
+
+    if (app.out)
+        fclose(app.out);
+    if (rc == 0 && !quiet) {
+        print_summary(stats);
+        if (app.realtime)
+            print_audio_source(&app, target_us);
+        if (app.ring_every)
+            printf("line ring: late lines %u\n", video_output_line_ring_get_late());
+        if (app.cache_repeat) {
+            video_output_line_cache_stats_t cache = video_output_line_cache_get_stats();
+            printf("line cache: last frame drawn %u reused %u missed %u\n", cache.drawn, cache.reused, cache.missed);
+        }
+        if (app.present_buffers)
+            printf("present: presents %u released %u waits %u\n", app.presents, app.released, app.present_waits);
+    }
+    if (rc == 0 && csv_path && write_csv(stats, csv_path) != 0)
+        rc = -1;
+    if (rc == 0 && stats->bad_commands)
+        rc = -1;
+    if (app.switch_failed) {
+        fprintf(stderr, "%s: a switched-to mode or pixel format does not fit\n", argv[0]);
+        rc = -1;
+    }
+    free(stats);
+    for (int i = 0; i < VIDEO_PIXEL_FORMAT_COUNT; i++) {
+        free(app.framebuffers[i]);
+        free(app.window_copies[i]);
+        for (int j = 0; j < MAX_PRESENT_BUFFERS - 1; j++)
+            free(app.present_copies[i][j]);
+    }
+    return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/**
+ * Deterministic video/audio sources for the host tools.
+ *
+ * The emulator renders and feeds these, so anything that decodes its output
+ * can regenerate the exact same pixels and samples to compare against.
+ */
+
+#ifndef HOST_PATTERN_H
+#define HOST_PATTERN_H
+
+#include "pico_hdmi/video_output.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HOST_PATTERN_TONE_HZ 1000
+#define HOST_PATTERN_TONE_AMPLITUDE 8000
+
+/**
+ * RGB565 test pattern: eight colour bars whose brightness varies with the
+ * line, plus a one-pixel diagonal so pixel pairs are never identical.
+ */
+static inline uint16_t host_pattern_pixel(uint32_t x, uint32_t y)
+{
+    static const uint16_t bars[8] = {0xFFFF, 0xFFE0, 0x07FF, 0x07E0, 0xF81F, 0xF800, 0x001F, 0x0000};
+    if ((x & 0xffu) == (y & 0xffu))
+        return (uint16_t)(0x8410u ^ (x * 0x0821u));
+    uint16_t c = bars[(x * 8u / 640u) & 7u];
+    uint16_t shade = (uint16_t)((y >> 4) & 0x1fu);
+    return (uint16_t)(c ^ (shade | (shade << 6) | (shade << 11)));
+}
+
+// RGB565 colour of the letterbox border in hdmi_emu -b
+#define HOST_PATTERN_BORDER 0x4a69u
+
+// Names of video_pixel_format_t values for the tools' -P and -S options
+static const char *const host_pattern_format_names[VIDEO_PIXEL_FORMAT_COUNT] = {"rgb565", "rgb555", "rgb332", "y4"};
+
+static inline bool host_pattern_find_format(const char *name, video_pixel_format_t *format)
+{
+    for (int i = 0; i < VIDEO_PIXEL_FORMAT_COUNT; i++) {
+        if (strcmp(host_pattern_format_names[i], name) == 0) {
+            *format = (video_pixel_format_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * RGB565 colour c reduced to a pixel format, as packed into a line.
+ */
+static inline uint32_t host_pattern_pack(uint16_t c, video_pixel_format_t format)
+{
+    uint32_t r = c >> 11, g = (c >> 5) & 0x3fu, b = c & 0x1fu;
+    switch (format) {
+        case VIDEO_PIXEL_FORMAT_RGB555:
+            return (r << 10) | ((g >> 1) << 5) | b;
+        case VIDEO_PIXEL_FORMAT_RGB332:
+            return ((r >> 2) << 5) | ((g >> 3) << 2) | (b >> 3);
+        case VIDEO_PIXEL_FORMAT_Y4:
+            return (((r << 3) * 77u) + ((g << 2) * 150u) + ((b << 3) * 29u)) >> 12;
+        default:
+            return c;
+    }
+}
+
+/**
+ * The red, green and blue values the TMDS encoder sends for packed pixel p:
+ * each channel at the top of the byte, low bits zero.
+ */
+static inline void host_pattern_expand(uint32_t p, video_pixel_format_t format, uint8_t rgb[3])
+{
+    switch (format) {
+        case VIDEO_PIXEL_FORMAT_RGB555:
+            rgb[0] = (uint8_t)(((p >> 10) & 0x1fu) << 3);
+            rgb[1] = (uint8_t)(((p >> 5) & 0x1fu) << 3);
+            rgb[2] = (uint8_t)((p & 0x1fu) << 3);
+            break;
+        case VIDEO_PIXEL_FORMAT_RGB332:
+            rgb[0] = (uint8_t)(((p >> 5) & 0x7u) << 5);
+            rgb[1] = (uint8_t)(((p >> 2) & 0x7u) << 5);
+            rgb[2] = (uint8_t)((p & 0x3u) << 6);
+            break;
+        case VIDEO_PIXEL_FORMAT_Y4:
+            rgb[0] = rgb[1] = rgb[2] = (uint8_t)((p & 0xfu) << 4);
+            break;
+        default:
+            rgb[0] = (uint8_t)((p >> 11) << 3);
+            rgb[1] = (uint8_t)(((p >> 5) & 0x3fu) << 2);
+            rgb[2] = (uint8_t)((p & 0x1fu) << 3);
+            break;
+    }
+}
+
+/**
+ * Pattern line y as width pixels of a format, packed from bit 0 of dst[0] up.
+ * width * bpp must be a multiple of 32.
+ */
+static inline void host_pattern_line(uint32_t *dst, uint32_t y, uint32_t width, video_pixel_format_t format)
+{
+    const uint32_t bpp = video_pixel_format_bpp(format);
+    uint32_t word = 0, bit = 0;
+    for (uint32_t x = 0; x < width; x++) {
+        word |= host_pattern_pack(host_pattern_pixel(x, y), format) << bit;
+        bit += bpp;
+        if (bit == 32) {
+            *dst++ = word;
+            word = 0;
+            bit = 0;
+        }
+    }
+}
+
+/**
+ * Sample n of a stereo test signal: a 1 kHz triangle on the left channel and
+ * its inverse on the right. Integer-only so every host produces identical PCM.
+ */
+static inline void host_pattern_sample(uint32_t n, int16_t *left, int16_t *right)
+{
+    const uint32_t period = 48000u / HOST_PATTERN_TONE_HZ;
+    uint32_t phase = n % period;
+    int32_t half = (int32_t)period / 2;
+    int32_t tri = (int32_t)phase < half ? (int32_t)phase : (int32_t)period - (int32_t)phase;
+    int32_t v = ((tri * 4 * HOST_PATTERN_TONE_AMPLITUDE) / (int32_t)period) - HOST_PATTERN_TONE_AMPLITUDE;
+    *left = (int16_t)v;
+    *right = (int16_t)-v;
+}
+
+#endif // HOST_PATTERN_H
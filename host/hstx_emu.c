@@ -0,0 +1,449 @@
+#include "hstx_emu.h"
+
+#include "pico/stdlib.h"
+
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/structs/hstx_ctrl.h"
+#include "hardware/structs/hstx_fifo.h"
+
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Command encodings (mirror video_output.c)
+#define HSTX_CMD_RAW 0x0u
+#define HSTX_CMD_RAW_REPEAT 0x1u
+#define HSTX_CMD_TMDS 0x2u
+#define HSTX_CMD_TMDS_REPEAT 0x3u
+#define HSTX_CMD_NOP 0xfu
+
+typedef enum {
+    HSTX_ST_CMD,
+    HSTX_ST_RAW,
+    HSTX_ST_RAW_REPEAT,
+    HSTX_ST_TMDS,
+    HSTX_ST_TMDS_REPEAT,
+} hstx_state_t;
+
+static struct {
+    const hstx_emu_config_t *cfg;
+    hstx_emu_stats_t *stats;
+    jmp_buf exit_env;
+    bool running;
+    bool in_step;
+    bool done;
+
+    // HSTX command interpreter
+    hstx_state_t state;
+    uint32_t remaining;
+    int disparity[3];
+
+    // Output frame, in the mode being output when it started
+    uint32_t *frame;
+    uint32_t frame_capacity;
+    uint32_t frame_pos;
+    uint32_t frame_symbols;
+    uint32_t h_total;
+    uint32_t v_total;
+    uint32_t last_line; // Line of the previous frame's final symbol
+
+    // Stream time: seconds up to the last pixel clock change, then symbols since
+    double clock_base_s;
+    uint64_t clock_symbols;
+    uint32_t pixel_clock_khz;
+
+    // Time the handler reprogrammed the DMA, 0 until it has
+    uint64_t reprogram_ns;
+} emu;
+
+// ============================================================================
+// TMDS Encoder
+// ============================================================================
+
+uint32_t hstx_emu_tmds_encode(uint8_t d, int *disparity)
+{
+    int n1 = __builtin_popcount(d);
+    bool use_xnor = n1 > 4 || (n1 == 4 && !(d & 1));
+
+    uint32_t qm = d & 1u;
+    for (int i = 1; i < 8; i++) {
+        uint32_t bit = ((qm >> (i - 1)) ^ (d >> i)) & 1u;
+        if (use_xnor)
+            bit ^= 1u;
+        qm |= bit << i;
+    }
+    if (!use_xnor)
+        qm |= 1u << 8;
+
+    bool qm8 = (qm >> 8) & 1u;
+    int n1q = __builtin_popcount(qm & 0xffu);
+    int n0q = 8 - n1q;
+    uint32_t q;
+
+    if (*disparity == 0 || n1q == n0q) {
+        q = (qm8 ? (qm & 0xffu) : (~qm & 0xffu)) | (qm & 0x100u) | ((qm8 ? 0u : 1u) << 9);
+        *disparity += qm8 ? (n1q - n0q) : (n0q - n1q);
+    } else if ((*disparity > 0 && n1q > n0q) || (*disparity < 0 && n0q > n1q)) {
+        q = (1u << 9) | (qm & 0x100u) | (~qm & 0xffu);
+        *disparity += (qm8 ? 2 : 0) + (n0q - n1q);
+    } else {
+        q = qm & 0x1ffu;
+        *disparity += (qm8 ? 0 : -2) + (n1q - n0q);
+    }
+    return q;
+}
+
+// ============================================================================
+// HSTX Shifter / Expander
+// ============================================================================
+
+static inline uint32_t rotr32(uint32_t v, uint32_t n)
+{
+    n &= 31u;
+    return n ? (v >> n) | (v << (32u - n)) : v;
+}
+
+static inline uint32_t field(uint32_t reg, uint32_t bits, uint32_t lsb)
+{
+    return (reg & bits) >> lsb;
+}
+
+// Take the geometry of the mode being output. A mode switch lands at a frame
+// boundary, so this is called between frames.
+static bool start_frame(void)
+{
+    const video_mode_t *mode = video_output_get_mode();
+    uint32_t symbols = video_mode_h_total(mode) * video_mode_v_total(mode);
+    if (symbols > emu.frame_capacity) {
+        uint32_t *frame = realloc(emu.frame, symbols * sizeof(uint32_t));
+        if (!frame)
+            return false;
+        emu.frame = frame;
+        emu.frame_capacity = symbols;
+    }
+    emu.frame_symbols = symbols;
+    emu.h_total = video_mode_h_total(mode);
+    emu.v_total = video_mode_v_total(mode);
+
+    if (mode->pixel_clock_khz != emu.pixel_clock_khz) {
+        if (emu.pixel_clock_khz)
+            emu.clock_base_s += (double)emu.clock_symbols / (emu.pixel_clock_khz * 1000.0);
+        emu.clock_symbols = 0;
+        emu.pixel_clock_khz = mode->pixel_clock_khz;
+    }
+    return true;
+}
+
+static void emit_symbol(uint32_t sym)
+{
+    emu.frame[emu.frame_pos++] = sym & 0x3fffffffu;
+    emu.stats->symbols++;
+    emu.clock_symbols++;
+    if (emu.frame_pos == emu.frame_symbols) {
+        if (emu.cfg->frame_done)
+            emu.cfg->frame_done(emu.frame, emu.frame_symbols, emu.stats->frames, emu.cfg->ctx);
+        emu.frame_pos = 0;
+        emu.last_line = emu.v_total - 1;
+        if (++emu.stats->frames >= emu.cfg->frames)
+            emu.done = true;
+        else if (!start_frame())
+            longjmp(emu.exit_env, 3);
+    }
+}
+
+static uint32_t tmds_pixel(uint32_t sr)
+{
+    uint32_t cfg = hstx_ctrl_hw->expand_tmds;
+    const uint32_t rot[3] = {
+        field(cfg, HSTX_CTRL_EXPAND_TMDS_L0_ROT_BITS, HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB),
+        field(cfg, HSTX_CTRL_EXPAND_TMDS_L1_ROT_BITS, HSTX_CTRL_EXPAND_TMDS_L1_ROT_LSB),
+        field(cfg, HSTX_CTRL_EXPAND_TMDS_L2_ROT_BITS, HSTX_CTRL_EXPAND_TMDS_L2_ROT_LSB),
+    };
+    const uint32_t nbits[3] = {
+        field(cfg, HSTX_CTRL_EXPAND_TMDS_L0_NBITS_BITS, HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB),
+        field(cfg, HSTX_CTRL_EXPAND_TMDS_L1_NBITS_BITS, HSTX_CTRL_EXPAND_TMDS_L1_NBITS_LSB),
+        field(cfg, HSTX_CTRL_EXPAND_TMDS_L2_NBITS_BITS, HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB),
+    };
+
+    uint32_t sym = 0;
+    for (int lane = 0; lane < 3; lane++) {
+        // NBITS+1 valid bits, counted down from bit 7 of the rotated data
+        uint8_t mask = (uint8_t)(0xff00u >> (nbits[lane] + 1));
+        uint8_t d = (uint8_t)rotr32(sr, rot[lane]) & mask;
+        sym |= hstx_emu_tmds_encode(d, &emu.disparity[lane]) << (lane * 10);
+    }
+    return sym;
+}
+
+// Shift one FIFO word out through the raw or TMDS path, up to emu.remaining outputs
+static void shift_word(uint32_t w, bool tmds)
+{
+    uint32_t cfg = hstx_ctrl_hw->expand_shift;
+    uint32_t n_shifts, shift;
+    if (tmds) {
+        n_shifts = field(cfg, HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_BITS, HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB);
+        shift = field(cfg, HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_BITS, HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB);
+    } else {
+        n_shifts = field(cfg, HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_BITS, HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_LSB);
+        shift = field(cfg, HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_BITS, HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_LSB);
+    }
+    if (n_shifts == 0)
+        n_shifts = 32;
+
+    uint32_t sr = w;
+    for (uint32_t i = 0; i < n_shifts && emu.remaining; i++, emu.remaining--) {
+        emit_symbol(tmds ? tmds_pixel(sr) : sr);
+        sr = rotr32(sr, shift);
+    }
+}
+
+static void hstx_fifo_push(uint32_t w)
+{
+    switch (emu.state) {
+        case HSTX_ST_CMD: {
+            uint32_t cmd = (w >> 12) & 0xfu;
+            emu.remaining = w & 0xfffu;
+            switch (cmd) {
+                case HSTX_CMD_RAW:
+                    emu.state = HSTX_ST_RAW;
+                    break;
+                case HSTX_CMD_RAW_REPEAT:
+                    emu.state = HSTX_ST_RAW_REPEAT;
+                    break;
+                case HSTX_CMD_TMDS:
+                    emu.state = HSTX_ST_TMDS;
+                    break;
+                case HSTX_CMD_TMDS_REPEAT:
+                    emu.state = HSTX_ST_TMDS_REPEAT;
+                    break;
+                case HSTX_CMD_NOP:
+                    break;
+                default:
+                    emu.stats->bad_commands++;
+                    break;
+            }
+            if (emu.remaining == 0)
+                emu.state = HSTX_ST_CMD;
+            // The DVI encoder resets its disparity counter in control periods
+            if (emu.state == HSTX_ST_RAW || emu.state == HSTX_ST_RAW_REPEAT)
+                memset(emu.disparity, 0, sizeof(emu.disparity));
+            return;
+        }
+        case HSTX_ST_RAW:
+        case HSTX_ST_TMDS:
+            shift_word(w, emu.state == HSTX_ST_TMDS);
+            break;
+        case HSTX_ST_RAW_REPEAT:
+        case HSTX_ST_TMDS_REPEAT:
+            while (emu.remaining)
+                shift_word(w, emu.state == HSTX_ST_TMDS_REPEAT);
+            break;
+    }
+    if (emu.remaining == 0)
+        emu.state = HSTX_ST_CMD;
+}
+
+// ============================================================================
+// DMA Engine
+// ============================================================================
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+}
+
+static void mark_reprogram(void)
+{
+    if (!emu.reprogram_ns)
+        emu.reprogram_ns = now_ns();
+}
+
+// Line of the last symbol emitted
+static inline uint32_t current_line(void)
+{
+    return emu.frame_pos ? (emu.frame_pos - 1) / emu.h_total : emu.last_line;
+}
+
+// A DMA write into another channel's registers; a write to CTRL_TRIG triggers it
+static void dma_register_write(uintptr_t addr)
+{
+    uintptr_t offset = addr - (uintptr_t)dma_hw->ch;
+    uint target = (uint)(offset / sizeof(dma_channel_hw_t));
+    if (offset % sizeof(dma_channel_hw_t) == offsetof(dma_channel_hw_t, ctrl_trig))
+        dma_channel_start(target);
+}
+
+// A narrow read is replicated across the 32-bit write bus, as on hardware
+static uint32_t dma_read(uintptr_t addr, uint32_t size)
+{
+    switch (size) {
+        case 1:
+            return *(const volatile uint8_t *)addr * 0x01010101u;
+        case 2:
+            return *(const volatile uint16_t *)addr * 0x00010001u;
+        default:
+            return *(const volatile uint32_t *)addr;
+    }
+}
+
+static void dma_write(uintptr_t addr, uint32_t size, uint32_t w)
+{
+    switch (size) {
+        case 1:
+            *(volatile uint8_t *)addr = (uint8_t)w;
+            break;
+        case 2:
+            *(volatile uint16_t *)addr = (uint16_t)w;
+            break;
+        default:
+            *(volatile uint32_t *)addr = w;
+            break;
+    }
+}
+
+static void run_channel(uint ch_num)
+{
+    dma_channel_hw_t *ch = &dma_hw->ch[ch_num];
+    uint32_t ctrl = ch->ctrl_trig;
+    uint32_t count = ch->transfer_count;
+    uintptr_t read = ch->read_addr;
+    uintptr_t write = ch->write_addr;
+    bool incr_read = (ctrl & DMA_CH0_CTRL_TRIG_INCR_READ_BITS) != 0;
+    bool incr_write = (ctrl & DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS) != 0;
+    uint ring_bits = field(ctrl, DMA_CH0_CTRL_TRIG_RING_SIZE_BITS, DMA_CH0_CTRL_TRIG_RING_SIZE_LSB);
+    uintptr_t ring_mask = ring_bits ? ((uintptr_t)1 << ring_bits) - 1 : ~(uintptr_t)0;
+    bool ring_write = (ctrl & DMA_CH0_CTRL_TRIG_RING_SEL_BITS) != 0;
+    uint32_t size = 1u << field(ctrl, DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS, DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t w = dma_read(read, size);
+        if (write == (uintptr_t)&hstx_fifo_hw->fifo) {
+            // The FIFO takes every write as a whole word
+            hstx_fifo_push(w);
+            emu.stats->line[current_line()].dma_words++;
+            emu.stats->line[current_line()].dma_bytes += size;
+        } else {
+            dma_write(write, size, w);
+            if (write >= (uintptr_t)dma_hw->ch && write < (uintptr_t)(dma_hw->ch + NUM_DMA_CHANNELS))
+                dma_register_write(write);
+        }
+        if (incr_read) {
+            uintptr_t mask = ring_write ? ~(uintptr_t)0 : ring_mask;
+            read = (read & ~mask) | ((read + size) & mask);
+        }
+        if (incr_write) {
+            uintptr_t mask = ring_write ? ring_mask : ~(uintptr_t)0;
+            write = (write & ~mask) | ((write + size) & mask);
+        }
+    }
+
+    ch->read_addr = read;
+    ch->write_addr = write;
+    ch->ctrl_trig = ctrl & ~DMA_CH0_CTRL_TRIG_BUSY_BITS;
+
+    // The FIFO is full when the last word is accepted, so the chained channel has not read
+    // anything yet when the IRQ is taken: it runs on the next step, after the handler.
+    uint chain_to = field(ctrl, DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS, DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+    if (chain_to != ch_num)
+        dma_channel_start(chain_to);
+
+    if (ctrl & DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS)
+        return;
+
+    dma_hw->intr = 1U << ch_num;
+    dma_hw->ints0 = dma_hw->intr & dma_hw->inte0;
+    irq_handler_t handler = host_irq_get_handler(DMA_IRQ_0);
+    if (dma_hw->ints0 && handler) {
+        hstx_emu_line_stats_t *ls = &emu.stats->line[current_line()];
+        emu.reprogram_ns = 0;
+        uint64_t t0 = now_ns();
+        handler();
+        uint64_t dt = now_ns() - t0;
+        uint64_t dr = emu.reprogram_ns ? emu.reprogram_ns - t0 : dt;
+        ls->irqs++;
+        ls->total_ns += dt;
+        if (dt > ls->max_ns)
+            ls->max_ns = dt;
+        ls->reprogram_total_ns += dr;
+        if (dr > ls->reprogram_max_ns)
+            ls->reprogram_max_ns = dr;
+        emu.stats->irqs++;
+    }
+    // INTR is write-1-to-clear on hardware; treat the handler as having acknowledged it
+    dma_hw->intr = 0;
+    dma_hw->ints0 = 0;
+}
+
+static void emu_step(void)
+{
+    if (!emu.running || emu.in_step)
+        return;
+    emu.in_step = true;
+
+    if (emu.cfg->producer)
+        emu.cfg->producer(emu.cfg->ctx);
+
+    uint ch_num = 0;
+    while (ch_num < NUM_DMA_CHANNELS && !dma_channel_is_busy(ch_num))
+        ch_num++;
+    if (ch_num == NUM_DMA_CHANNELS) {
+        emu.in_step = false;
+        longjmp(emu.exit_env, 2);
+    }
+    run_channel(ch_num);
+
+    emu.in_step = false;
+    if (emu.done)
+        longjmp(emu.exit_env, 1);
+}
+
+// ============================================================================
+// Public Interface
+// ============================================================================
+
+double hstx_emu_seconds(void)
+{
+    if (!emu.pixel_clock_khz)
+        return 0.0;
+    return emu.clock_base_s + ((double)emu.clock_symbols / (emu.pixel_clock_khz * 1000.0));
+}
+
+int hstx_emu_run(const hstx_emu_config_t *cfg, hstx_emu_stats_t *stats)
+{
+    memset(&emu, 0, sizeof(emu));
+    memset(stats, 0, sizeof(*stats));
+    emu.cfg = cfg;
+    emu.stats = stats;
+    if (!start_frame())
+        return -1;
+
+    host_set_idle_hook(emu_step);
+    host_set_dma_reprogram_hook(mark_reprogram);
+    emu.running = true;
+
+    int rc = setjmp(emu.exit_env);
+    if (rc == 0)
+        video_output_core1_run();
+
+    emu.running = false;
+    host_set_idle_hook(NULL);
+    host_set_dma_reprogram_hook(NULL);
+    free(emu.frame);
+    emu.frame = NULL;
+
+    if (rc == 2) {
+        fprintf(stderr, "hstx_emu: DMA chain stalled after %llu symbols\n", (unsigned long long)stats->symbols);
+        return -1;
+    }
+    if (rc == 3) {
+        fprintf(stderr, "hstx_emu: out of memory after %u frames\n", stats->frames);
+        return -1;
+    }
+    return 0;
+}
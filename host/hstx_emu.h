@@ -0,0 +1,73 @@
+/**
+ * Host-side HSTX/DMA emulator for pico_hdmi.
+ *
+ * Runs the real video_output_core1_run() against the stubbed SDK. Every time
+ * the core 1 loop idles, one DMA block is played into an HSTX command
+ * interpreter (RAW, RAW_REPEAT, TMDS, TMDS_REPEAT, NOP) and the completion IRQ
+ * is delivered to dma_irq_handler() exactly as the ping/pong chain does on
+ * hardware. The result is the 30-bit symbol stream, one word per pixel clock
+ * (lane 0 in bits 9:0, lane 1 in 19:10, lane 2 in 29:20).
+ */
+
+#ifndef HSTX_EMU_H
+#define HSTX_EMU_H
+
+#include "pico_hdmi/video_output.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ISR work attributed to the scanline on which the IRQ fired
+typedef struct {
+    uint32_t irqs;               // IRQs taken on this line (summed over all frames)
+    uint32_t dma_words;          // Words the DMA moved into the HSTX FIFO on this line
+    uint32_t dma_bytes;          // Bytes it read for them: less than 4 per word for narrow transfers
+    uint64_t total_ns;           // Host time spent in dma_irq_handler()
+    uint64_t max_ns;             // Worst single IRQ on this line
+    uint64_t reprogram_total_ns; // IRQ entry until the finished channel has its next block
+    uint64_t reprogram_max_ns;   // Worst entry-to-reprogram latency on this line
+} hstx_emu_line_stats_t;
+
+typedef struct {
+    hstx_emu_line_stats_t line[VIDEO_OUTPUT_MAX_V_TOTAL_LINES];
+    uint32_t frames;       // Complete frames emitted
+    uint64_t symbols;      // Total symbols emitted
+    uint64_t irqs;         // Total DMA IRQs delivered
+    uint32_t bad_commands; // Unknown HSTX command words seen
+} hstx_emu_stats_t;
+
+typedef struct {
+    uint32_t frames; // Stop after this many complete frames
+
+    // Optional "core 0" work, run before every DMA block
+    void (*producer)(void *ctx);
+
+    // Optional sink, called once per complete frame of count words: h_total * v_total
+    // of the mode the frame was output in
+    void (*frame_done)(const uint32_t *symbols, uint32_t count, uint32_t frame, void *ctx);
+
+    void *ctx;
+} hstx_emu_config_t;
+
+/**
+ * Run video_output_core1_run() until cfg->frames frames have been emitted.
+ * video_output_init() must already have been called. The producer may switch
+ * modes with video_output_set_mode(), as long as it does not wait on a pending
+ * switch: it runs inside the emulator, so nothing would complete it.
+ *
+ * @return 0 on success, -1 if the DMA chain stalled (no busy channel)
+ */
+int hstx_emu_run(const hstx_emu_config_t *cfg, hstx_emu_stats_t *stats);
+
+/**
+ * Stream time of the last symbol emitted, at the pixel clock of each mode output
+ * so far; 0 before hstx_emu_run() starts.
+ */
+double hstx_emu_seconds(void);
+
+/**
+ * TMDS 8b/10b encode one byte with running disparity, as the HSTX encoder does.
+ */
+uint32_t hstx_emu_tmds_encode(uint8_t d, int *disparity);
+
+#endif // HSTX_EMU_H
@@ -0,0 +1,19 @@
+/**
+ * Reference copies of the original scalar packet encoders.
+ *
+ * Kept verbatim from the first release of hstx_packet.c so hdmi_bench can time
+ * optimised paths against them and check the output is bit-identical.
+ */
+
+#ifndef REF_PACKET_H
+#define REF_PACKET_H
+
+#include "pico_hdmi/hstx_packet.h"
+
+void ref_packet_compute_parity(hstx_packet_t *packet);
+int ref_packet_set_audio_samples(hstx_packet_t *packet, const audio_sample_t *samples, int num_samples,
+                                 int frame_count);
+void ref_encode_data_island(hstx_data_island_t *out, const hstx_packet_t *packet, bool vsync_active,
+                            bool hsync_active);
+
+#endif // REF_PACKET_H
@@ -0,0 +1,100 @@
+/**
+ * Host stub of hardware/dma.h.
+ *
+ * Channel registers are plain memory. Address registers are widened to
+ * uintptr_t so the library can keep writing (uintptr_t)pointer into them on a
+ * 64-bit host. Nothing moves until the emulator steps the channels.
+ */
+
+#ifndef HARDWARE_DMA_H
+#define HARDWARE_DMA_H
+
+#include "pico.h"
+
+#define NUM_DMA_CHANNELS 16u
+#define DREQ_HSTX 52u
+#define DREQ_FORCE 63u
+
+#define DMA_CH0_CTRL_TRIG_EN_BITS 0x00000001u
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB 2u
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS 0x0000000cu
+#define DMA_CH0_CTRL_TRIG_INCR_READ_BITS 0x00000010u
+#define DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS 0x00000040u
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_LSB 8u
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_BITS 0x00000f00u
+#define DMA_CH0_CTRL_TRIG_RING_SEL_BITS 0x00001000u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB 13u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS 0x0001e000u
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB 17u
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS 0x007e0000u
+#define DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS 0x00800000u
+#define DMA_CH0_CTRL_TRIG_BUSY_BITS 0x04000000u
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2,
+};
+
+// Only the first register alias is modelled, padded so a control channel can write
+// it through a power-of-two write ring. AL1_CTRL shares CTRL_TRIG's storage: CPU
+// stores never trigger here, and the emulator triggers on DMA writes to CTRL_TRIG.
+typedef struct __attribute__((aligned(4 * sizeof(uintptr_t)))) {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uint32_t transfer_count; // Reload value: the emulator never writes it back
+    union {
+        volatile uint32_t ctrl_trig;
+        volatile uint32_t al1_ctrl;
+    };
+} dma_channel_hw_t;
+
+typedef struct {
+    dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+    volatile uint32_t intr;
+    volatile uint32_t inte0;
+    volatile uint32_t intf0;
+    volatile uint32_t ints0;
+} dma_hw_t;
+
+extern dma_hw_t *const dma_hw;
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+void dma_channel_claim(uint channel);
+void dma_channel_unclaim(uint channel);
+int dma_claim_unused_channel(bool required);
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits);
+void channel_config_set_irq_quiet(dma_channel_config *c, bool irq_quiet);
+uint32_t channel_config_get_ctrl_value(const dma_channel_config *config);
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_start(uint channel);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+
+/**
+ * Host only. The library calls this (as VIDEO_OUTPUT_DMA_REPROGRAMMED()) once
+ * the IRQ handler has handed the finished channel its next block, so the
+ * emulator can time IRQ entry to reprogram.
+ */
+void host_dma_reprogrammed(void);
+
+/**
+ * Install the function run by host_dma_reprogrammed(). NULL restores a no-op.
+ */
+void host_set_dma_reprogram_hook(void (*hook)(void));
+
+#endif // HARDWARE_DMA_H
@@ -0,0 +1,12 @@
+/**
+ * Host stub of hardware/gpio.h.
+ */
+
+#ifndef HARDWARE_GPIO_H
+#define HARDWARE_GPIO_H
+
+#include "pico.h"
+
+void gpio_set_function(uint gpio, uint fn);
+
+#endif // HARDWARE_GPIO_H
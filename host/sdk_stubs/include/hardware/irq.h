@@ -0,0 +1,27 @@
+/**
+ * Host stub of hardware/irq.h.
+ *
+ * Only the DMA IRQ is modelled. The registered handler is invoked by the
+ * emulator when a DMA channel with its INTE0 bit set completes.
+ */
+
+#ifndef HARDWARE_IRQ_H
+#define HARDWARE_IRQ_H
+
+#include "pico.h"
+
+typedef void (*irq_handler_t)(void);
+
+#define DMA_IRQ_0 10
+#define DMA_IRQ_1 11
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_priority(uint num, uint8_t hardware_priority);
+void irq_set_enabled(uint num, bool enabled);
+
+/**
+ * Host only: handler registered for an IRQ, or NULL if none/disabled.
+ */
+irq_handler_t host_irq_get_handler(uint num);
+
+#endif // HARDWARE_IRQ_H
@@ -0,0 +1,22 @@
+/**
+ * Host stub of hardware/structs/bus_ctrl.h.
+ */
+
+#ifndef HARDWARE_STRUCTS_BUS_CTRL_H
+#define HARDWARE_STRUCTS_BUS_CTRL_H
+
+#include "pico.h"
+
+#define BUSCTRL_BUS_PRIORITY_PROC0_BITS 0x00000001u
+#define BUSCTRL_BUS_PRIORITY_PROC1_BITS 0x00000010u
+#define BUSCTRL_BUS_PRIORITY_DMA_R_BITS 0x00000100u
+#define BUSCTRL_BUS_PRIORITY_DMA_W_BITS 0x00001000u
+
+typedef struct {
+    volatile uint32_t priority;
+    volatile uint32_t priority_ack;
+} bus_ctrl_hw_t;
+
+extern bus_ctrl_hw_t *const bus_ctrl_hw;
+
+#endif // HARDWARE_STRUCTS_BUS_CTRL_H
@@ -0,0 +1,59 @@
+/**
+ * Host stub of hardware/structs/hstx_ctrl.h.
+ *
+ * Register layout and field positions follow the RP2350 datasheet so the
+ * emulator can decode whatever configuration video_output_core1_run() writes.
+ */
+
+#ifndef HARDWARE_STRUCTS_HSTX_CTRL_H
+#define HARDWARE_STRUCTS_HSTX_CTRL_H
+
+#include "pico.h"
+
+#define HSTX_CTRL_CSR_EN_BITS 0x00000001u
+#define HSTX_CTRL_CSR_EXPAND_EN_BITS 0x00000002u
+#define HSTX_CTRL_CSR_SHIFT_LSB 8u
+#define HSTX_CTRL_CSR_SHIFT_BITS 0x00001f00u
+#define HSTX_CTRL_CSR_N_SHIFTS_LSB 16u
+#define HSTX_CTRL_CSR_N_SHIFTS_BITS 0x001f0000u
+#define HSTX_CTRL_CSR_CLKPHASE_LSB 24u
+#define HSTX_CTRL_CSR_CLKDIV_LSB 28u
+#define HSTX_CTRL_CSR_CLKDIV_BITS 0xf0000000u
+
+#define HSTX_CTRL_BIT0_SEL_P_LSB 0u
+#define HSTX_CTRL_BIT0_SEL_N_LSB 8u
+#define HSTX_CTRL_BIT0_INV_BITS 0x00010000u
+#define HSTX_CTRL_BIT0_CLK_BITS 0x00020000u
+
+#define HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_LSB 0u
+#define HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_BITS 0x0000001fu
+#define HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_LSB 8u
+#define HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_BITS 0x00001f00u
+#define HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB 16u
+#define HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_BITS 0x001f0000u
+#define HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB 24u
+#define HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_BITS 0x1f000000u
+
+#define HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB 0u
+#define HSTX_CTRL_EXPAND_TMDS_L0_ROT_BITS 0x0000001fu
+#define HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB 5u
+#define HSTX_CTRL_EXPAND_TMDS_L0_NBITS_BITS 0x000000e0u
+#define HSTX_CTRL_EXPAND_TMDS_L1_ROT_LSB 8u
+#define HSTX_CTRL_EXPAND_TMDS_L1_ROT_BITS 0x00001f00u
+#define HSTX_CTRL_EXPAND_TMDS_L1_NBITS_LSB 13u
+#define HSTX_CTRL_EXPAND_TMDS_L1_NBITS_BITS 0x0000e000u
+#define HSTX_CTRL_EXPAND_TMDS_L2_ROT_LSB 16u
+#define HSTX_CTRL_EXPAND_TMDS_L2_ROT_BITS 0x001f0000u
+#define HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB 21u
+#define HSTX_CTRL_EXPAND_TMDS_L2_NBITS_BITS 0x00e00000u
+
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t bit[8];
+    volatile uint32_t expand_shift;
+    volatile uint32_t expand_tmds;
+} hstx_ctrl_hw_t;
+
+extern hstx_ctrl_hw_t *const hstx_ctrl_hw;
+
+#endif // HARDWARE_STRUCTS_HSTX_CTRL_H
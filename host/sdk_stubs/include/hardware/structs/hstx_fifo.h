@@ -0,0 +1,17 @@
+/**
+ * Host stub of hardware/structs/hstx_fifo.h.
+ */
+
+#ifndef HARDWARE_STRUCTS_HSTX_FIFO_H
+#define HARDWARE_STRUCTS_HSTX_FIFO_H
+
+#include "pico.h"
+
+typedef struct {
+    volatile uint32_t stat;
+    volatile uint32_t fifo;
+} hstx_fifo_hw_t;
+
+extern hstx_fifo_hw_t *const hstx_fifo_hw;
+
+#endif // HARDWARE_STRUCTS_HSTX_FIFO_H
@@ -0,0 +1,29 @@
+/**
+ * Host stub of hardware/sync.h.
+ *
+ * The emulator delivers IRQs synchronously from tight_loop_contents(), so
+ * nothing can preempt a critical section, and barriers only need to stop
+ * compiler reordering.
+ */
+
+#ifndef HARDWARE_SYNC_H
+#define HARDWARE_SYNC_H
+
+#include <stdint.h>
+
+static inline void __dmb(void)
+{
+    __asm__ volatile("" : : : "memory");
+}
+
+static inline uint32_t save_and_disable_interrupts(void)
+{
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status)
+{
+    (void)status;
+}
+
+#endif // HARDWARE_SYNC_H
@@ -0,0 +1,30 @@
+/**
+ * Host stub of the Pico SDK base header.
+ *
+ * Provides just enough of pico.h for the pico_hdmi sources to compile on a
+ * host (x86 Linux) toolchain. Section placement attributes become no-ops.
+ */
+
+#ifndef PICO_H
+#define PICO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#define __scratch_x(group)
+#define __scratch_y(group)
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __noinline __attribute__((noinline))
+#define __no_inline_not_in_flash_func(func_name) __noinline func_name
+
+#define __compiler_memory_barrier() __asm__ volatile("" : : : "memory")
+
+#ifndef count_of
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#endif // PICO_H
@@ -0,0 +1,21 @@
+/**
+ * Host stub of pico/stdlib.h.
+ */
+
+#ifndef PICO_STDLIB_H
+#define PICO_STDLIB_H
+
+#include "pico.h"
+
+/**
+ * Called from every idle loop in the library. On the host this is where the
+ * emulator advances the DMA/HSTX model (see host_set_idle_hook()).
+ */
+void tight_loop_contents(void);
+
+/**
+ * Install the function run by tight_loop_contents(). NULL restores a no-op.
+ */
+void host_set_idle_hook(void (*hook)(void));
+
+#endif // PICO_STDLIB_H
@@ -0,0 +1,230 @@
+/**
+ * Host implementations of the Pico SDK calls used by pico_hdmi.
+ *
+ * Registers live in ordinary memory. Configuration calls only record state;
+ * the emulator (hstx_emu.c) is what interprets it.
+ */
+
+#include "pico/stdlib.h"
+
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/structs/bus_ctrl.h"
+#include "hardware/structs/hstx_ctrl.h"
+#include "hardware/structs/hstx_fifo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// ============================================================================
+// Register Blocks
+// ============================================================================
+
+static dma_hw_t dma_regs;
+static hstx_ctrl_hw_t hstx_ctrl_regs;
+static hstx_fifo_hw_t hstx_fifo_regs;
+static bus_ctrl_hw_t bus_ctrl_regs;
+
+dma_hw_t *const dma_hw = &dma_regs;
+hstx_ctrl_hw_t *const hstx_ctrl_hw = &hstx_ctrl_regs;
+hstx_fifo_hw_t *const hstx_fifo_hw = &hstx_fifo_regs;
+bus_ctrl_hw_t *const bus_ctrl_hw = &bus_ctrl_regs;
+
+// ============================================================================
+// pico/stdlib
+// ============================================================================
+
+static void (*idle_hook)(void) = NULL;
+
+void host_set_idle_hook(void (*hook)(void))
+{
+    idle_hook = hook;
+}
+
+void tight_loop_contents(void)
+{
+    if (idle_hook)
+        idle_hook();
+}
+
+// ============================================================================
+// hardware/gpio, hardware/irq
+// ============================================================================
+
+void gpio_set_function(uint gpio, uint fn)
+{
+    (void)gpio;
+    (void)fn;
+}
+
+#define HOST_NUM_IRQS 64
+static irq_handler_t irq_handlers[HOST_NUM_IRQS];
+static bool irq_enabled[HOST_NUM_IRQS];
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    if (num < HOST_NUM_IRQS)
+        irq_handlers[num] = handler;
+}
+
+void irq_set_priority(uint num, uint8_t hardware_priority)
+{
+    (void)num;
+    (void)hardware_priority;
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    if (num < HOST_NUM_IRQS)
+        irq_enabled[num] = enabled;
+}
+
+irq_handler_t host_irq_get_handler(uint num)
+{
+    if (num >= HOST_NUM_IRQS || !irq_enabled[num])
+        return NULL;
+    return irq_handlers[num];
+}
+
+// ============================================================================
+// hardware/dma
+// ============================================================================
+
+static uint32_t dma_claimed = 0;
+
+void dma_channel_claim(uint channel)
+{
+    if (dma_claimed & (1U << channel)) {
+        fprintf(stderr, "dma_channel_claim: channel %u already claimed\n", channel);
+        abort();
+    }
+    dma_claimed |= 1U << channel;
+}
+
+void dma_channel_unclaim(uint channel)
+{
+    dma_claimed &= ~(1U << channel);
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if (!(dma_claimed & (1U << ch))) {
+            dma_claimed |= 1U << ch;
+            return (int)ch;
+        }
+    }
+    if (required) {
+        fprintf(stderr, "dma_claim_unused_channel: no channels left\n");
+        abort();
+    }
+    return -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    dma_channel_config c = {0};
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, DREQ_FORCE);
+    channel_config_set_chain_to(&c, channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    c.ctrl |= DMA_CH0_CTRL_TRIG_EN_BITS;
+    return c;
+}
+
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to)
+{
+    c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS) | (chain_to << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq)
+{
+    c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS) | (dreq << DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB);
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr)
+{
+    c->ctrl = incr ? (c->ctrl | DMA_CH0_CTRL_TRIG_INCR_READ_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_INCR_READ_BITS);
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr)
+{
+    c->ctrl = incr ? (c->ctrl | DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS);
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size)
+{
+    c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS) | ((uint32_t)size << DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+}
+
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits)
+{
+    c->ctrl = (c->ctrl & ~(DMA_CH0_CTRL_TRIG_RING_SIZE_BITS | DMA_CH0_CTRL_TRIG_RING_SEL_BITS)) |
+              (size_bits << DMA_CH0_CTRL_TRIG_RING_SIZE_LSB) | (write ? DMA_CH0_CTRL_TRIG_RING_SEL_BITS : 0);
+}
+
+void channel_config_set_irq_quiet(dma_channel_config *c, bool irq_quiet)
+{
+    c->ctrl = irq_quiet ? (c->ctrl | DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS);
+}
+
+uint32_t channel_config_get_ctrl_value(const dma_channel_config *config)
+{
+    return config->ctrl;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    dma_channel_hw_t *ch = &dma_hw->ch[channel];
+    ch->write_addr = (uintptr_t)write_addr;
+    ch->read_addr = (uintptr_t)read_addr;
+    ch->transfer_count = transfer_count;
+    ch->ctrl_trig = config->ctrl & ~DMA_CH0_CTRL_TRIG_BUSY_BITS;
+    if (trigger)
+        dma_channel_start(channel);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger)
+{
+    dma_hw->ch[channel].read_addr = (uintptr_t)read_addr;
+    if (trigger)
+        dma_channel_start(channel);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+    dma_hw->ch[channel].transfer_count = trans_count;
+    if (trigger)
+        dma_channel_start(channel);
+}
+
+void dma_channel_start(uint channel)
+{
+    dma_hw->ch[channel].ctrl_trig |= DMA_CH0_CTRL_TRIG_BUSY_BITS;
+}
+
+void dma_channel_abort(uint channel)
+{
+    dma_hw->ch[channel].ctrl_trig &= ~DMA_CH0_CTRL_TRIG_BUSY_BITS;
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    return (dma_hw->ch[channel].ctrl_trig & DMA_CH0_CTRL_TRIG_BUSY_BITS) != 0;
+}
+
+static void (*dma_reprogram_hook)(void) = NULL;
+
+void host_set_dma_reprogram_hook(void (*hook)(void))
+{
+    dma_reprogram_hook = hook;
+}
+
+void host_dma_reprogrammed(void)
+{
+    if (dma_reprogram_hook)
+        dma_reprogram_hook();
+}
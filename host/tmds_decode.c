@@ -0,0 +1,427 @@
+#include "tmds_decode.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LANE(w, n) (((w) >> ((n) * 10)) & 0x3ffu)
+
+// Control period codes, indexed by {vsync, hsync} (HDMI 1.3a Section 5.4.2)
+static const uint16_t ctrl_codes[4] = {0x354, 0x0ab, 0x154, 0x2ab};
+
+// TERC4 codes (HDMI 1.3a Section 5.4.3)
+static const uint16_t terc4_codes[16] = {
+    0x29c, 0x263, 0x2e4, 0x2e2, 0x171, 0x11e, 0x18e, 0x13c,
+    0x2cc, 0x139, 0x19c, 0x2c6, 0x28e, 0x271, 0x163, 0x2c3,
+};
+
+#define DATA_GUARD_BAND 0x133u // Lanes 1 and 2 during data island guard bands
+#define VIDEO_GB_LANE02 0x2ccu // Video guard band, lanes 0 and 2
+#define VIDEO_GB_LANE1 0x133u  // Video guard band, lane 1
+
+// ============================================================================
+// Symbol Level
+// ============================================================================
+
+int tmds_decode_ctrl(uint32_t sym)
+{
+    for (int i = 0; i < 4; i++) {
+        if (ctrl_codes[i] == sym)
+            return i;
+    }
+    return -1;
+}
+
+int tmds_decode_terc4(uint32_t sym)
+{
+    for (int i = 0; i < 16; i++) {
+        if (terc4_codes[i] == sym)
+            return i;
+    }
+    return -1;
+}
+
+uint8_t tmds_decode_data(uint32_t sym)
+{
+    uint32_t d = sym & 0xffu;
+    if (sym & 0x200u)
+        d = ~d & 0xffu;
+    bool xor_coded = (sym & 0x100u) != 0;
+
+    uint8_t out = d & 1u;
+    for (int i = 1; i < 8; i++) {
+        uint32_t bit = ((d >> i) ^ (d >> (i - 1))) & 1u;
+        if (!xor_coded)
+            bit ^= 1u;
+        out |= (uint8_t)(bit << i);
+    }
+    return out;
+}
+
+uint8_t tmds_bch(const uint8_t *data, int len)
+{
+    uint8_t ecc = 0;
+    for (int i = 0; i < len; i++) {
+        for (int b = 0; b < 8; b++) {
+            uint8_t feedback = (ecc ^ (data[i] >> b)) & 1u;
+            ecc = (uint8_t)((ecc >> 1) ^ (feedback ? 0x83u : 0u));
+        }
+    }
+    return ecc;
+}
+
+// ============================================================================
+// Data Islands
+// ============================================================================
+
+bool tmds_decode_packet(const uint32_t *symbols, hstx_packet_t *packet, tmds_packet_status_t *status)
+{
+    memset(packet, 0, sizeof(*packet));
+    memset(status, 0, sizeof(*status));
+    status->terc4_ok = true;
+    status->framing_ok = true;
+
+    for (int k = 0; k < W_DATA_PACKET; k++) {
+        int c0 = tmds_decode_terc4(LANE(symbols[k], 0));
+        int c1 = tmds_decode_terc4(LANE(symbols[k], 1));
+        int c2 = tmds_decode_terc4(LANE(symbols[k], 2));
+        if (c0 < 0 || c1 < 0 || c2 < 0) {
+            status->terc4_ok = false;
+            continue;
+        }
+
+        // Lane 0: D0 = hsync, D1 = vsync, D2 = header bit, D3 = 0 on the first clock only
+        if (((c0 >> 3) & 1) != (k != 0))
+            status->framing_ok = false;
+        if (k == 0) {
+            status->hsync = c0 & 1;
+            status->vsync = (c0 >> 1) & 1;
+        }
+        packet->header[k / 8] |= (uint8_t)(((c0 >> 2) & 1) << (k % 8));
+
+        // Lanes 1/2: bit n carries even/odd bits of subpacket n, two bits per clock
+        for (int n = 0; n < 4; n++) {
+            uint8_t bits = (uint8_t)(((c1 >> n) & 1) | (((c2 >> n) & 1) << 1));
+            packet->subpacket[n][k / 4] |= (uint8_t)(bits << ((k % 4) * 2));
+        }
+    }
+
+    status->header_ok = tmds_bch(packet->header, 3) == packet->header[3];
+    for (int n = 0; n < 4; n++) {
+        if (tmds_bch(packet->subpacket[n], 7) == packet->subpacket[n][7])
+            status->subpacket_ok |= (uint8_t)(1u << n);
+    }
+    return status->terc4_ok && status->framing_ok && status->header_ok && status->subpacket_ok == 0x0f;
+}
+
+static bool is_data_guard(uint32_t w, int *hv)
+{
+    int c0 = tmds_decode_terc4(LANE(w, 0));
+    if (c0 < 0 || (c0 & 0xc) != 0xc || LANE(w, 1) != DATA_GUARD_BAND || LANE(w, 2) != DATA_GUARD_BAND)
+        return false;
+    if (hv)
+        *hv = c0 & 3;
+    return true;
+}
+
+bool tmds_decode_island(const uint32_t *words, hstx_packet_t *packet, tmds_packet_status_t *status)
+{
+    bool ok = tmds_decode_packet(&words[W_GUARDBAND], packet, status);
+    int expect = (status->vsync << 1) | status->hsync;
+    for (int i = 0; i < W_GUARDBAND; i++) {
+        int hv_lead, hv_trail;
+        if (!is_data_guard(words[i], &hv_lead) || !is_data_guard(words[W_GUARDBAND + W_DATA_PACKET + i], &hv_trail))
+            return false;
+        if (hv_lead != expect || hv_trail != expect)
+            return false;
+    }
+    return ok;
+}
+
+// ============================================================================
+// Frame Decoder
+// ============================================================================
+
+static void add_error(tmds_decoder_t *dec, const char *fmt, ...)
+{
+    if (dec->error_count < TMDS_DECODE_MAX_ERRORS) {
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(dec->errors[dec->error_count], sizeof(dec->errors[0]), fmt, ap);
+        va_end(ap);
+    }
+    dec->error_count++;
+}
+
+int tmds_decoder_init(tmds_decoder_t *dec, const video_mode_t *mode)
+{
+    memset(dec, 0, sizeof(*dec));
+    return tmds_decoder_set_mode(dec, mode);
+}
+
+int tmds_decoder_set_mode(tmds_decoder_t *dec, const video_mode_t *mode)
+{
+    uint8_t(*rgb)[3] = calloc((size_t)mode->h_active_pixels * mode->v_active_lines, sizeof(*rgb));
+    if (!rgb)
+        return -1;
+    free(dec->rgb);
+    dec->rgb = rgb;
+    dec->mode = mode;
+    return 0;
+}
+
+void tmds_decoder_free(tmds_decoder_t *dec)
+{
+    free(dec->rgb);
+    free(dec->audio);
+    memset(dec, 0, sizeof(*dec));
+}
+
+static void push_sample(tmds_decoder_t *dec, const tmds_audio_sample_t *s)
+{
+    if (dec->audio_count == dec->audio_capacity) {
+        uint32_t cap = dec->audio_capacity ? dec->audio_capacity * 2 : 4096;
+        tmds_audio_sample_t *p = realloc(dec->audio, cap * sizeof(*p));
+        if (!p)
+            return;
+        dec->audio = p;
+        dec->audio_capacity = cap;
+    }
+    dec->audio[dec->audio_count++] = *s;
+}
+
+static bool even_parity(const uint8_t *d, int n, uint8_t extra)
+{
+    int ones = __builtin_popcount(extra);
+    for (int i = 0; i < n; i++)
+        ones += __builtin_popcount(d[i]);
+    return (ones & 1) == 0;
+}
+
+static bool infoframe_checksum_ok(const hstx_packet_t *p)
+{
+    unsigned sum = p->header[0] + p->header[1] + p->header[2];
+    int len = p->header[2] + 1;
+    for (int j = 0; j < 4 && len > 0; j++) {
+        for (int i = 0; i < 7 && len > 0; i++, len--)
+            sum += p->subpacket[j][i];
+    }
+    return (sum & 0xffu) == 0;
+}
+
+static void handle_packet(tmds_decoder_t *dec, const hstx_packet_t *p, uint64_t pos, tmds_line_info_t *li)
+{
+    uint8_t type = p->header[0];
+    dec->packets_by_type[type]++;
+    li->packets++;
+
+    switch (type) {
+        case TMDS_PACKET_ACR:
+            dec->acr_cts = ((p->subpacket[0][1] & 0x0fu) << 16) | (p->subpacket[0][2] << 8) | p->subpacket[0][3];
+            dec->acr_n = ((p->subpacket[0][4] & 0x0fu) << 16) | (p->subpacket[0][5] << 8) | p->subpacket[0][6];
+            break;
+        case TMDS_PACKET_AVI_INFOFRAME:
+            if (!infoframe_checksum_ok(p))
+                dec->checksum_errors++;
+            dec->avi_vic = p->subpacket[0][4] & 0x7fu;
+            break;
+        case TMDS_PACKET_AUDIO_INFOFRAME:
+            if (!infoframe_checksum_ok(p))
+                dec->checksum_errors++;
+            break;
+        case TMDS_PACKET_AUDIO_SAMPLE:
+            li->audio++;
+            for (int n = 0; n < 4; n++) {
+                if (!((p->header[1] >> n) & 1))
+                    continue;
+                const uint8_t *d = p->subpacket[n];
+                tmds_audio_sample_t s = {
+                    .left = (int16_t)(d[1] | (d[2] << 8)),
+                    .right = (int16_t)(d[4] | (d[5] << 8)),
+                    .b_flag = (p->header[2] >> (4 + n)) & 1,
+                    .parity_ok = even_parity(&d[0], 3, d[6] & 0x0fu) && even_parity(&d[3], 3, d[6] >> 4),
+                    .symbol = pos,
+                    .seconds = dec->seconds + ((double)(pos - dec->symbols) / (dec->mode->pixel_clock_khz * 1000.0)),
+                };
+                if (!s.parity_ok)
+                    dec->parity_errors++;
+                push_sample(dec, &s);
+                dec->audio_frame_samples++;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void track_sync(const video_mode_t *mode, tmds_line_info_t *li, int x, int hv)
+{
+    if ((hv & 1) == mode->h_sync_positive) {
+        if (li->hsync_start < 0)
+            li->hsync_start = (int16_t)x;
+        li->hsync_width++;
+    }
+    if (((hv >> 1) & 1) == mode->v_sync_positive)
+        li->vsync = true;
+}
+
+static void decode_line(tmds_decoder_t *dec, const uint32_t *s, uint32_t y, uint64_t base)
+{
+    const video_mode_t *mode = dec->mode;
+    const int h_total = (int)video_mode_h_total(mode);
+    tmds_line_info_t *li = &dec->line[y];
+    memset(li, 0, sizeof(*li));
+    li->hsync_start = -1;
+
+    int di_preamble = 0;
+    int video_preamble = 0;
+    bool in_video = false;
+    uint8_t(*row)[3] = NULL;
+
+    int x = 0;
+    while (x < h_total) {
+        uint32_t w = s[x];
+        int c0 = tmds_decode_ctrl(LANE(w, 0));
+        int c1 = tmds_decode_ctrl(LANE(w, 1));
+        int c2 = tmds_decode_ctrl(LANE(w, 2));
+
+        if (c0 >= 0 && c1 >= 0 && c2 >= 0) {
+            if (in_video)
+                add_error(dec, "line %u: video period ends early at %d", y, x);
+            in_video = false;
+            track_sync(dec->mode, li, x, c0);
+            // Preambles: CTL0..3 = 1010 for data islands, 1000 for video
+            if (c1 == 1 && c2 == 1) {
+                di_preamble++;
+                video_preamble = 0;
+                li->preamble++;
+            } else if (c1 == 1 && c2 == 0) {
+                video_preamble++;
+                di_preamble = 0;
+                li->preamble++;
+            } else {
+                di_preamble = 0;
+                video_preamble = 0;
+                li->control++;
+            }
+            x++;
+            continue;
+        }
+
+        int hv;
+        if (!in_video && is_data_guard(w, &hv)) {
+            if (di_preamble != W_PREAMBLE)
+                add_error(dec, "line %u: data island at %d after %d preamble clocks", y, x, di_preamble);
+            di_preamble = 0;
+            if (x + W_GUARDBAND > h_total || !is_data_guard(s[x + 1], NULL))
+                add_error(dec, "line %u: short leading guard band at %d", y, x);
+            for (int i = 0; i < W_GUARDBAND; i++)
+                track_sync(dec->mode, li, x + i, hv);
+            x += W_GUARDBAND;
+            li->guard += W_GUARDBAND;
+
+            int packets = 0;
+            while (x + W_DATA_PACKET <= h_total && !is_data_guard(s[x], NULL)) {
+                hstx_packet_t p;
+                tmds_packet_status_t st;
+                if (!tmds_decode_packet(&s[x], &p, &st)) {
+                    dec->bch_errors++;
+                    add_error(dec, "line %u: bad packet at %d (terc4 %d framing %d hdr %d sp %x)", y, x, st.terc4_ok,
+                              st.framing_ok, st.header_ok, st.subpacket_ok);
+                }
+                for (int i = 0; i < W_DATA_PACKET; i++)
+                    track_sync(dec->mode, li, x + i, (st.vsync << 1) | st.hsync);
+                handle_packet(dec, &p, base + (uint64_t)x, li);
+                x += W_DATA_PACKET;
+                li->island += W_DATA_PACKET;
+                packets++;
+            }
+            if (packets == 0 || packets > 18)
+                add_error(dec, "line %u: island with %d packets", y, packets);
+            if (x + W_GUARDBAND > h_total || !is_data_guard(s[x], NULL) ||
+                !is_data_guard(s[x + 1], NULL)) {
+                add_error(dec, "line %u: missing trailing guard band at %d", y, x);
+                return;
+            }
+            for (int i = 0; i < W_GUARDBAND; i++)
+                track_sync(dec->mode, li, x + i, hv);
+            x += W_GUARDBAND;
+            li->guard += W_GUARDBAND;
+            continue;
+        }
+
+        if (!in_video && LANE(w, 0) == VIDEO_GB_LANE02 && LANE(w, 1) == VIDEO_GB_LANE1 &&
+            LANE(w, 2) == VIDEO_GB_LANE02) {
+            if (video_preamble != 8)
+                add_error(dec, "line %u: video guard band at %d after %d preamble clocks", y, x, video_preamble);
+            if (x + 2 > h_total || s[x + 1] != w)
+                add_error(dec, "line %u: short video guard band at %d", y, x);
+            video_preamble = 0;
+            x += 2;
+            li->guard += 2;
+            in_video = true;
+            if (dec->active_lines < mode->v_active_lines)
+                row = &dec->rgb[dec->active_lines * mode->h_active_pixels];
+            dec->active_lines++;
+            continue;
+        }
+
+        if (!in_video && di_preamble == 0 && video_preamble == 0) {
+            // DVI: pixels follow the control period with no preamble or guard band
+            in_video = true;
+            if (dec->active_lines < mode->v_active_lines)
+                row = &dec->rgb[dec->active_lines * mode->h_active_pixels];
+            dec->active_lines++;
+        }
+
+        if (in_video) {
+            if (row && li->video < mode->h_active_pixels) {
+                row[li->video][0] = tmds_decode_data(LANE(w, 2));
+                row[li->video][1] = tmds_decode_data(LANE(w, 1));
+                row[li->video][2] = tmds_decode_data(LANE(w, 0));
+            }
+            li->video++;
+            x++;
+            continue;
+        }
+
+        add_error(dec, "line %u: unexpected symbol %08x at %d", y, w, x);
+        x++;
+    }
+
+    if (li->video && li->video != mode->h_active_pixels)
+        add_error(dec, "line %u: %u active pixels", y, li->video);
+}
+
+uint32_t tmds_decode_frame(tmds_decoder_t *dec, const uint32_t *symbols)
+{
+    const video_mode_t *mode = dec->mode;
+    const uint32_t h_total = video_mode_h_total(mode);
+    const uint32_t v_total = video_mode_v_total(mode);
+    uint32_t errors_before = dec->error_count;
+    uint64_t base = dec->symbols;
+
+    dec->active_lines = 0;
+    dec->audio_frame_samples = 0;
+
+    for (uint32_t y = 0; y < v_total; y++)
+        decode_line(dec, &symbols[y * h_total], y, base + ((uint64_t)y * h_total));
+
+    // Timing checks against the configured mode
+    for (uint32_t y = 0; y < v_total; y++) {
+        const tmds_line_info_t *li = &dec->line[y];
+        bool want_vsync = y >= mode->v_front_porch && y < mode->v_front_porch + mode->v_sync_width;
+        if (li->hsync_start != mode->h_front_porch || li->hsync_width != mode->h_sync_width)
+            add_error(dec, "line %u: hsync at %d width %d", y, li->hsync_start, li->hsync_width);
+        if (li->vsync != want_vsync)
+            add_error(dec, "line %u: vsync %s", y, li->vsync ? "unexpected" : "missing");
+    }
+    if (dec->active_lines != mode->v_active_lines)
+        add_error(dec, "frame %u: %u active lines", dec->frames, dec->active_lines);
+
+    dec->frames++;
+    dec->symbols += (uint64_t)h_total * v_total;
+    dec->seconds += (double)h_total * v_total / (mode->pixel_clock_khz * 1000.0);
+    return dec->error_count - errors_before;
+}
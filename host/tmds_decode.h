@@ -0,0 +1,159 @@
+/**
+ * Reference decoder for the HSTX symbol stream.
+ *
+ * The inverse of the TMDS encoder, the ter_c4 table and
+ * hstx_encode_data_island(). It is written from the HDMI 1.3a description
+ * rather than from the library's own tables, so it can act as the golden
+ * reference for encoder changes.
+ *
+ * Each symbol is one pixel clock: lane 0 in bits 9:0, lane 1 in 19:10,
+ * lane 2 in 29:20 (the format written by hstx_emu).
+ */
+
+#ifndef TMDS_DECODE_H
+#define TMDS_DECODE_H
+
+#include "pico_hdmi/hstx_packet.h"
+#include "pico_hdmi/video_output.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TMDS_DECODE_MAX_ERRORS 16
+
+// Data island packet types (HDMI 1.3a Table 5-8)
+#define TMDS_PACKET_NULL 0x00
+#define TMDS_PACKET_ACR 0x01
+#define TMDS_PACKET_AUDIO_SAMPLE 0x02
+#define TMDS_PACKET_AVI_INFOFRAME 0x82
+#define TMDS_PACKET_AUDIO_INFOFRAME 0x84
+
+// ============================================================================
+// Symbol Level
+// ============================================================================
+
+/**
+ * Decode a 10-bit control symbol to {vsync, hsync} (bit 1, bit 0).
+ * @return 0-3, or -1 if the symbol is not a control symbol
+ */
+int tmds_decode_ctrl(uint32_t sym);
+
+/**
+ * Decode a 10-bit TERC4 symbol.
+ * @return 0-15, or -1 if the symbol is not a TERC4 code
+ */
+int tmds_decode_terc4(uint32_t sym);
+
+/**
+ * Decode a 10-bit TMDS video data symbol to its 8-bit value.
+ */
+uint8_t tmds_decode_data(uint32_t sym);
+
+/**
+ * HDMI BCH ECC (generator 1 + x^6 + x^7 + x^8), computed bit-serially.
+ */
+uint8_t tmds_bch(const uint8_t *data, int len);
+
+// ============================================================================
+// Data Islands
+// ============================================================================
+
+typedef struct {
+    bool header_ok;         // Header BCH matched
+    uint8_t subpacket_ok;   // Bit n set if subpacket n BCH matched
+    bool terc4_ok;          // Every symbol was a valid TERC4 code
+    bool framing_ok;        // Lane 0 D3 was 0 on the first clock and 1 afterwards
+    bool vsync;             // Sync levels carried on lane 0
+    bool hsync;
+} tmds_packet_status_t;
+
+/**
+ * Decode the 32 symbols of one data island packet.
+ * @return true if the packet decoded cleanly with all BCH checks passing
+ */
+bool tmds_decode_packet(const uint32_t *symbols, hstx_packet_t *packet, tmds_packet_status_t *status);
+
+/**
+ * Decode a single-packet island as produced by hstx_encode_data_island():
+ * two guard band words, the 32 packet symbols, two guard band words.
+ * @return true if guard bands and packet are all valid
+ */
+bool tmds_decode_island(const uint32_t *words, hstx_packet_t *packet, tmds_packet_status_t *status);
+
+// ============================================================================
+// Frame Decoder
+// ============================================================================
+
+typedef struct {
+    uint16_t control;     // Control period symbols (excluding preambles)
+    uint16_t preamble;    // Data island and video preamble symbols
+    uint16_t guard;       // Data island and video guard band symbols
+    uint16_t island;      // Data island packet symbols
+    uint16_t video;       // Active pixels
+    uint8_t packets;      // Data island packets on this line
+    uint8_t audio;        // Audio sample packets on this line
+    int16_t hsync_start;  // First clock with hsync asserted, -1 if none
+    int16_t hsync_width;  // Clocks with hsync asserted
+    bool vsync;           // vsync asserted on this line
+} tmds_line_info_t;
+
+typedef struct {
+    int16_t left;
+    int16_t right;
+    bool b_flag;     // Start of a 192-frame IEC 60958 block
+    bool parity_ok;  // Both subframe parity bits correct
+    uint64_t symbol; // Stream position of the carrying packet
+    double seconds;  // Stream time of the carrying packet
+} tmds_audio_sample_t;
+
+typedef struct {
+    const video_mode_t *mode; // Timing and sync polarity the stream is checked against
+
+    // Current frame
+    tmds_line_info_t line[VIDEO_OUTPUT_MAX_V_TOTAL_LINES];
+    uint8_t (*rgb)[3];     // v_active_lines rows of h_active_pixels R, G, B
+    uint32_t active_lines; // Lines that carried video
+
+    // Whole stream
+    uint32_t frames;
+    uint64_t symbols;
+    double seconds; // Stream time, at the pixel clock of each frame's mode
+    uint32_t packets_by_type[256];
+    uint32_t bch_errors;
+    uint32_t parity_errors;
+    uint32_t checksum_errors; // InfoFrame checksum failures
+    uint32_t acr_n;
+    uint32_t acr_cts;
+    uint8_t avi_vic;
+
+    tmds_audio_sample_t *audio;
+    uint32_t audio_count;
+    uint32_t audio_capacity;
+    uint32_t audio_frame_samples; // Samples decoded in the last frame
+
+    uint32_t error_count;
+    char errors[TMDS_DECODE_MAX_ERRORS][96];
+} tmds_decoder_t;
+
+/**
+ * @return 0 on success, -1 on allocation failure
+ */
+int tmds_decoder_init(tmds_decoder_t *dec, const video_mode_t *mode);
+void tmds_decoder_free(tmds_decoder_t *dec);
+
+/**
+ * Check the following frames against another mode, for a stream that switches
+ * modes. Stream totals carry on.
+ * @return 0 on success, -1 on allocation failure (keeping the current mode)
+ */
+int tmds_decoder_set_mode(tmds_decoder_t *dec, const video_mode_t *mode);
+
+/**
+ * Decode one frame of h_total * v_total symbols of the decoder's mode that
+ * starts on line 0 (the first front porch line). Appends audio samples and
+ * accumulates packet statistics; per-line info and pixels describe this frame.
+ * @return number of new structural or ECC errors found in this frame
+ */
+uint32_t tmds_decode_frame(tmds_decoder_t *dec, const uint32_t *symbols);
+
+#endif // TMDS_DECODE_H
@@ -0,0 +1,85 @@
+#ifndef HSTX_AUDIO_FIFO_H
+#define HSTX_AUDIO_FIFO_H
+
+#include "pico_hdmi/hstx_packet.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// FIFO Configuration
+// ============================================================================
+
+// Capacity in milliseconds of 48 kHz stereo audio (4 bytes per sample).
+// Override with target_compile_definitions(pico_hdmi PUBLIC ...).
+#ifndef HSTX_AUDIO_FIFO_MS
+#define HSTX_AUDIO_FIFO_MS 20
+#endif
+
+// Packets the Core 1 loop keeps in the Data Island queue ahead of the scheduler
+// (~83 us each). Buffering beyond this stays in the FIFO as raw samples.
+#ifndef HSTX_AUDIO_FIFO_QUEUE_PACKETS
+#define HSTX_AUDIO_FIFO_QUEUE_PACKETS 16
+#endif
+
+#define HSTX_AUDIO_FIFO_RATE 48000
+#define HSTX_AUDIO_FIFO_SAMPLES (HSTX_AUDIO_FIFO_MS * (HSTX_AUDIO_FIFO_RATE / 1000))
+
+// ============================================================================
+// Public Interface
+// ============================================================================
+
+/**
+ * PCM FIFO owned by the library.
+ *
+ * The application (typically Core 0) writes raw stereo samples; the Core 1 loop
+ * in video_output_core1_run() packetises and encodes them into the Data Island
+ * queue between scanline IRQs. Single producer, single consumer, lock-free.
+ * Do not feed the Data Island queue with audio directly while using the FIFO.
+ */
+
+/**
+ * Empty the FIFO. Call before video_output_core1_run() starts.
+ */
+void hstx_audio_fifo_init(void);
+
+/**
+ * Write interleaved stereo samples.
+ * @return Number of samples written, less than count if the FIFO is full.
+ */
+uint32_t hstx_audio_fifo_write(const audio_sample_t *samples, uint32_t count);
+
+/**
+ * @return Number of samples that can be written without blocking.
+ */
+uint32_t hstx_audio_fifo_get_free(void);
+
+/**
+ * @return Number of samples waiting to be packetised.
+ */
+uint32_t hstx_audio_fifo_get_level(void);
+
+/**
+ * Low-latency mode: hold the total audio buffering (FIFO plus Data Island
+ * queue) at target_us, and absorb any offset between the source's sample
+ * clock and the 60 Hz video clock with a fine resampler (up to +/-1%) run on
+ * Core 1. The source should write in small blocks, well under target_us.
+ * 0 restores bit-exact pass-through. Empties the FIFO: call while audio is
+ * stopped, e.g. before video_output_core1_run().
+ */
+void hstx_audio_fifo_set_low_latency(uint32_t target_us);
+
+/**
+ * @return Current low-latency resampler correction in ppm (positive: the
+ *         source is running fast and samples are consumed faster).
+ */
+int32_t hstx_audio_fifo_get_rate_adjust_ppm(void);
+
+/**
+ * Move complete 4-sample groups into the Data Island queue, keeping it
+ * HSTX_AUDIO_FIFO_QUEUE_PACKETS deep.
+ * Called from the Core 1 loop; not needed by applications.
+ */
+void hstx_audio_fifo_service(void);
+
+#endif // HSTX_AUDIO_FIFO_H
@@ -6,22 +6,133 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// ============================================================================
+// Queue Configuration
+// ============================================================================
+// Override with target_compile_definitions(pico_hdmi PUBLIC ...).
+//
+//   Storage             Memory (256 slots)   Encode cost lands on
+//   LATE_ENCODE 0       144 B/slot = 36 KB   the producer
+//   LATE_ENCODE 1       36 B/slot = 9 KB     core 1 idle loop (ENCODE_AHEAD > 0)
+//                      + 144 B/ahead slot    or the DMA ISR (ENCODE_AHEAD = 0)
+//
+// Latency is set by how full the producer keeps the queue, not by its size.
+
+// Queue depth in data islands. Each 4-sample audio packet is ~83 us of 48 kHz audio.
+#ifndef HSTX_DI_QUEUE_SIZE
+#define HSTX_DI_QUEUE_SIZE 256
+#endif
+
+// 1: store raw 36-byte packets and TERC4-encode them shortly before they are sent.
+// 0: store pre-encoded 144-byte islands.
+#ifndef HSTX_DI_QUEUE_LATE_ENCODE
+#define HSTX_DI_QUEUE_LATE_ENCODE 1
+#endif
+
+// With late encoding, how many islands the core 1 loop keeps encoded ahead of the
+// scheduler. 0 encodes each island in the DMA ISR as it is sent. Must divide
+// HSTX_DI_QUEUE_SIZE, and must not be 1: the island being sent stays in place.
+#ifndef HSTX_DI_QUEUE_ENCODE_AHEAD
+#define HSTX_DI_QUEUE_ENCODE_AHEAD 4
+#endif
+
+// ============================================================================
+// Producer Interface
+// ============================================================================
+
 /**
  * Initialize the Data Island queue and scheduler.
  */
 void hstx_di_queue_init(void);
 
 /**
- * Push a pre-encoded Data Island into the queue.
+ * Audio samples per line of h_total_pixels at 48 kHz, in 16.16 fixed point,
+ * for hstx_di_queue_set_timing().
+ */
+uint32_t hstx_di_queue_samples_per_line(uint32_t pixel_clock_khz, uint32_t h_total_pixels);
+
+/**
+ * Set the scheduler's audio rate and the vsync/hsync arguments the queue passes
+ * to hstx_encode_data_island(), matching where the mode's audio islands sit.
+ * Called by video_output_init(), and from the DMA ISR when the mode changes.
+ * Islands already encoded with other sync arguments have their sync bits
+ * corrected as they are taken.
+ */
+void hstx_di_queue_set_timing(uint32_t samples_per_line, bool vsync, bool hsync);
+
+/**
+ * Reserve the next free slot so a packet can be built straight into it,
+ * e.g. hstx_packet_set_audio_samples(slot, ...), avoiding a copy.
+ * The slot is not visible to the scheduler until hstx_di_queue_commit().
+ * Only one slot may be reserved at a time, from a single producer.
+ *
+ * @return Pointer to the packet, or NULL if the queue is full.
+ */
+hstx_packet_t *hstx_di_queue_reserve_packet(void);
+
+/**
+ * Push a packet into the queue. It is sent as a Data Island with vsync inactive.
  * Returns true if successful, false if the queue is full.
  */
+bool hstx_di_queue_push_packet(const hstx_packet_t *packet);
+
+/**
+ * Packetise a block of interleaved stereo PCM into 4-sample audio packets,
+ * filling as many free slots as the block and the queue allow. The IEC 60958
+ * 192-frame counter is carried across calls (reset by hstx_di_queue_init()).
+ * Do not mix with other producers.
+ *
+ * @return Number of samples consumed: a multiple of 4, at most count.
+ */
+uint32_t hstx_di_queue_push_audio(const audio_sample_t *samples, uint32_t count);
+
+/**
+ * Reserve the next free slot so a Data Island can be encoded straight into it,
+ * e.g. hstx_encode_data_island(slot, &packet, ...), avoiding a copy.
+ * The slot is not visible to the scheduler until hstx_di_queue_commit().
+ * Only one slot may be reserved at a time, from a single producer.
+ * With late encoding the island is staged and commit decodes it back to its
+ * packet; an island that does not decode is dropped.
+ *
+ * @return Pointer to the slot, or NULL if the queue is full.
+ */
+hstx_data_island_t *hstx_di_queue_reserve(void);
+
+/**
+ * Push a pre-encoded Data Island into the queue. With late encoding it is
+ * decoded back to its packet and re-encoded before it is sent, so it must have
+ * been built by hstx_encode_data_island(); its sync bits are replaced.
+ * Returns true if successful, false if the queue is full or, with late
+ * encoding, the island does not decode.
+ */
 bool hstx_di_queue_push(const hstx_data_island_t *island);
 
+/**
+ * Publish the slot returned by the last successful reserve call.
+ */
+void hstx_di_queue_commit(void);
+
 /**
  * Get the current number of items in the queue.
  */
 uint32_t hstx_di_queue_get_level(void);
 
+/**
+ * Number of times audio ran dry: the scheduler owed a packet and the queue was
+ * empty. Counted once per dry spell, from the first packet sent.
+ */
+uint32_t hstx_di_queue_get_underruns(void);
+
+// ============================================================================
+// Scheduler Interface (Core 1)
+// ============================================================================
+
+/**
+ * Encode queued packets ahead of the scheduler (late encoding only).
+ * Called from the Core 1 loop between scanline IRQs.
+ */
+void hstx_di_queue_encode_ahead(void);
+
 /**
  * Advance the Data Island scheduler by one scanline.
  * Must be called exactly once per scanline in the DMA ISR.
@@ -29,7 +140,22 @@ uint32_t hstx_di_queue_get_level(void);
 void hstx_di_queue_tick(void);
 
 /**
- * Get the next audio Data Island packet if the scheduler determines it's time.
+ * Take the next audio Data Island if the scheduler determines it's time. The
+ * words stay valid in the queue, so the DMA can send them in place, until
+ * hstx_di_queue_release_audio_packet(). Up to two islands may be held.
+ *
+ * @return Pointer to 36-word HSTX data island, or NULL if no packet is due.
+ */
+const uint32_t *hstx_di_queue_take_audio_packet(void);
+
+/**
+ * Hand the oldest taken island's slot back to the producer.
+ */
+void hstx_di_queue_release_audio_packet(void);
+
+/**
+ * Take and immediately release the next audio Data Island, for callers that
+ * copy it straight away.
  *
  * @return Pointer to 36-word HSTX data island, or NULL if no packet is due.
  */
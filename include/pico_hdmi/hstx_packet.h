@@ -43,6 +43,9 @@ int hstx_packet_set_audio_samples(hstx_packet_t *packet, const audio_sample_t *s
                                   int frame_count);
 void hstx_packet_set_null(hstx_packet_t *packet);
 
+// Fill in the header and subpacket BCH bytes of a hand-built packet
+void hstx_packet_compute_parity(hstx_packet_t *packet);
+
 // ============================================================================
 // TERC4 encoding for HSTX
 // ============================================================================
@@ -50,4 +53,10 @@ void hstx_packet_set_null(hstx_packet_t *packet);
 void hstx_encode_data_island(hstx_data_island_t *out, const hstx_packet_t *packet, bool vsync, bool hsync);
 const uint32_t *hstx_get_null_data_island(bool vsync, bool hsync);
 
+// Rewrite the sync bits of an encoded island as if encoded with these vsync/hsync arguments
+void hstx_data_island_set_sync(hstx_data_island_t *island, bool vsync, bool hsync);
+
+// Recover the packet an island was encoded from. False if a symbol is not TERC4.
+bool hstx_decode_data_island(hstx_packet_t *out, const hstx_data_island_t *island);
+
 #endif // HSTX_PACKET_H
@@ -0,0 +1,72 @@
+#ifndef VIDEO_MODE_H
+#define VIDEO_MODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ============================================================================
+// Video Timing Modes
+// ============================================================================
+
+/**
+ * Timing for one video mode, in pixel clocks and lines.
+ *
+ * HSTX shifts one TMDS character per 5 system clocks, so clk_sys must be set to
+ * video_mode_sys_clock_khz() before video_output_core1_run() starts.
+ */
+typedef struct {
+    const char *name;
+    uint32_t pixel_clock_khz;
+
+    uint16_t h_front_porch;
+    uint16_t h_sync_width;
+    uint16_t h_back_porch;
+    uint16_t h_active_pixels;
+
+    uint16_t v_front_porch;
+    uint16_t v_sync_width;
+    uint16_t v_back_porch;
+    uint16_t v_active_lines;
+
+    bool h_sync_positive; // Sync pulse polarity: true for active-high
+    bool v_sync_positive;
+    uint8_t vic; // CEA-861 Video Identification Code for the AVI InfoFrame, 0 if none
+
+    // Send each source pixel twice: line buffers and framebuffer rows hold
+    // h_active_pixels / 2 pixels, and the pixel DMA reads half as many bytes
+    bool h_pixel_double;
+} video_mode_t;
+
+typedef enum {
+    VIDEO_MODE_640X480P60,     // VGA, CEA VIC 1: 25.2 MHz, clk_sys 126 MHz
+    VIDEO_MODE_720X480P60,     // CEA VIC 2 (4:3): 27 MHz, clk_sys 135 MHz
+    VIDEO_MODE_800X600P60,     // VESA SVGA: 40 MHz, clk_sys 200 MHz
+    VIDEO_MODE_1280X720P60_RB, // CVT reduced blanking: 64 MHz, clk_sys 320 MHz (overclocked)
+    VIDEO_MODE_320X480P60,     // 640x480 timing, each of 320 pixels sent twice
+    VIDEO_MODE_COUNT
+} video_mode_id_t;
+
+extern const video_mode_t video_modes[VIDEO_MODE_COUNT];
+
+static inline uint32_t video_mode_h_total(const video_mode_t *mode)
+{
+    return mode->h_front_porch + mode->h_sync_width + mode->h_back_porch + mode->h_active_pixels;
+}
+
+static inline uint32_t video_mode_v_total(const video_mode_t *mode)
+{
+    return mode->v_front_porch + mode->v_sync_width + mode->v_back_porch + mode->v_active_lines;
+}
+
+// Pixels per line in the scanline callback's buffer or a framebuffer row
+static inline uint32_t video_mode_source_width(const video_mode_t *mode)
+{
+    return mode->h_pixel_double ? mode->h_active_pixels / 2u : mode->h_active_pixels;
+}
+
+static inline uint32_t video_mode_sys_clock_khz(const video_mode_t *mode)
+{
+    return mode->pixel_clock_khz * 5;
+}
+
+#endif // VIDEO_MODE_H
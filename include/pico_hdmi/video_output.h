@@ -1,6 +1,8 @@
 #ifndef VIDEO_OUTPUT_H
 #define VIDEO_OUTPUT_H
 
+#include "pico_hdmi/video_mode.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -8,18 +10,80 @@
 // Video Output Configuration
 // ============================================================================
 
-#define MODE_H_FRONT_PORCH 16
-#define MODE_H_SYNC_WIDTH 96
-#define MODE_H_BACK_PORCH 48
-#define MODE_H_ACTIVE_PIXELS 640
+// Largest mode video_output_set_mode() accepts. Line buffers and scanline tables
+// are sized from these; lower them to save RAM when only small modes are used.
+#ifndef VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS
+#define VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS 1280
+#endif
+#ifndef VIDEO_OUTPUT_MAX_V_TOTAL_LINES
+#define VIDEO_OUTPUT_MAX_V_TOTAL_LINES 750
+#endif
+#ifndef VIDEO_OUTPUT_MAX_V_BLANK_LINES
+#define VIDEO_OUTPUT_MAX_V_BLANK_LINES 64
+#endif
+
+// Most spans a span callback can return for one line. Each adds two words to the
+// line buffers.
+#ifndef VIDEO_OUTPUT_MAX_SPANS
+#define VIDEO_OUTPUT_MAX_SPANS 32
+#endif
+
+// Most windows a window callback can return for one line. Each adds a 16-byte DMA
+// control block, two sets of them.
+#ifndef VIDEO_OUTPUT_MAX_WINDOWS
+#define VIDEO_OUTPUT_MAX_WINDOWS 4
+#endif
+
+// Either option below adds DMA channels 2 and 3, which reload PING and PONG from
+// control blocks. With both 0, only channels 0 and 1 are used.
 
-#define MODE_V_FRONT_PORCH 10
-#define MODE_V_SYNC_WIDTH 2
-#define MODE_V_BACK_PORCH 33
-#define MODE_V_ACTIVE_LINES 480
+// 1: runs of blanking lines that need no CPU work play from prebuilt control
+// blocks, so only lines with a dynamic audio island or a callback raise an IRQ.
+// 0: one IRQ per line.
+#ifndef VIDEO_OUTPUT_VBLANK_CHAIN
+#define VIDEO_OUTPUT_VBLANK_CHAIN 1
+#endif
 
-#define MODE_H_TOTAL_PIXELS (MODE_H_FRONT_PORCH + MODE_H_SYNC_WIDTH + MODE_H_BACK_PORCH + MODE_H_ACTIVE_PIXELS)
-#define MODE_V_TOTAL_LINES (MODE_V_FRONT_PORCH + MODE_V_SYNC_WIDTH + MODE_V_BACK_PORCH + MODE_V_ACTIVE_LINES)
+// 1: the DMA reads each audio island in place from the Data Island queue, between
+// static prefix and suffix segments. 0: the ISR copies it into a line buffer.
+#ifndef VIDEO_OUTPUT_DI_ZERO_COPY
+#define VIDEO_OUTPUT_DI_ZERO_COPY 1
+#endif
+
+// Line buffers in the render-ahead ring (video_output_set_line_ring()), each
+// VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS * 2 bytes. Two are held while the DMA reads them
+// and one is kept free, so lines can be finished up to SIZE - 3 ahead of the beam.
+// 0 leaves the ring out; otherwise at least 4.
+#ifndef VIDEO_OUTPUT_LINE_RING_SIZE
+#define VIDEO_OUTPUT_LINE_RING_SIZE 0
+#endif
+
+// Line buffers the cached scanline callback draws into, each
+// VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS * 2 bytes. A line can repeat any of the last
+// SIZE - 1 lines drawn. 0 leaves the cache out; otherwise at least 2.
+#ifndef VIDEO_OUTPUT_LINE_CACHE_SIZE
+#define VIDEO_OUTPUT_LINE_CACHE_SIZE 0
+#endif
+
+// ============================================================================
+// Pixel Formats
+// ============================================================================
+// Layouts the TMDS expander can read directly. Pixels are packed from bit 0 of each
+// 32-bit word up. Channels narrower than 8 bits are sent with their low bits zero.
+
+typedef enum {
+    VIDEO_PIXEL_FORMAT_RGB565, // 16 bpp: R 15:11, G 10:5, B 4:0 (default)
+    VIDEO_PIXEL_FORMAT_RGB555, // 16 bpp: R 14:10, G 9:5, B 4:0, bit 15 ignored
+    VIDEO_PIXEL_FORMAT_RGB332, // 8 bpp: R 7:5, G 4:2, B 1:0
+    VIDEO_PIXEL_FORMAT_Y4,     // 4 bpp greyscale, sent on all three channels
+    VIDEO_PIXEL_FORMAT_COUNT
+} video_pixel_format_t;
+
+static inline uint32_t video_pixel_format_bpp(video_pixel_format_t format)
+{
+    static const uint8_t bpp[VIDEO_PIXEL_FORMAT_COUNT] = {16, 16, 8, 4};
+    return bpp[format];
+}
 
 // Frame dimensions (set via video_output_init)
 extern uint16_t frame_width;
@@ -37,19 +101,136 @@ extern volatile uint32_t video_frame_count;
 
 typedef void (*video_output_task_fn)(void);
 typedef void (*video_output_vsync_cb_t)(void);
+typedef void (*video_output_present_cb_t)(const void *released);
 
 /**
  * Scanline Callback:
  * Called by the DVI library when it needs pixel data for a scanline.
  *
- * @param v_scanline The current vertical scanline (0 to MODE_V_TOTAL_LINES - 1)
- * @param active_line The current active video line (0 to MODE_V_ACTIVE_LINES - 1),
- *                    only valid if active_video is true.
- * @param line_buffer Buffer to fill with 640 RGB565 pixels (packed as uint32_t pairs).
- *                    The buffer MUST be filled with (MODE_H_ACTIVE_PIXELS / 2) uint32_t words.
+ * @param v_scanline The current vertical scanline (0 to v_total - 1 of the mode)
+ * @param active_line The current active video line (0 to v_active_lines - 1),
+ *                    only valid if active_video is true. With a letterbox, the
+ *                    content row (see video_output_set_letterbox()).
+ * @param line_buffer Buffer to fill with video_mode_source_width() pixels in the current
+ *                    pixel format (RGB565 pairs by default): h_active_pixels, or half that in
+ *                    a h_pixel_double mode. The buffer MUST be filled with
+ *                    (video_mode_source_width() * video_pixel_format_bpp() / 32) uint32_t words,
+ *                    or only the letterbox's content width.
  */
 typedef void (*video_output_scanline_cb_t)(uint32_t v_scanline, uint32_t active_line, uint32_t *line_buffer);
 
+#if VIDEO_OUTPUT_LINE_CACHE_SIZE
+/**
+ * Cached Scanline Callback:
+ * Like the scanline callback, for content where many lines repeat an earlier one,
+ * such as flat backgrounds. Instead of drawing, the callback can name an earlier
+ * active line of the same frame, e.g. active_line - 1 for "same as previous". The
+ * ISR then points the DMA at the cached buffer that already holds it.
+ *
+ * @param line_buffer Buffer to fill as for the scanline callback, or to leave
+ *                    untouched when repeating a line
+ * @return active_line once line_buffer is filled, or the earlier active line to
+ *         send again. The previous line is always still cached. Other lines are
+ *         cached if drawn or repeated among the last few lines (see
+ *         VIDEO_OUTPUT_LINE_CACHE_SIZE); a line that is not goes out black and
+ *         counts as missed.
+ */
+typedef uint32_t (*video_output_cached_scanline_cb_t)(uint32_t v_scanline, uint32_t active_line,
+                                                      uint32_t *line_buffer);
+
+/**
+ * Lines sent in one frame from the cached scanline callback.
+ */
+typedef struct {
+    uint32_t drawn;  // Lines the callback filled in
+    uint32_t reused; // Lines sent again from a cached buffer
+    uint32_t missed; // Repeats of lines no longer cached, sent black
+} video_output_line_cache_stats_t;
+#endif
+
+/**
+ * One piece of an active line from the span callback: a run of one colour, or raw
+ * pixels.
+ */
+typedef struct {
+    const void *pixels; // Raw pixels, packed like a scanline buffer and 4-byte aligned; NULL for a run
+    uint32_t colour;    // Run: the colour in the current pixel format
+    uint32_t length;    // Source pixels
+} video_span_t;
+
+/**
+ * Span Callback:
+ * Describes an active line as spans, left to right, for content that is mostly
+ * solid runs. The ISR sends each run as a TMDS_REPEAT command and one word, and
+ * each raw segment as a TMDS command followed by its pixels, copied out before the
+ * ISR returns. A solid line is two words for the DMA instead of a full line buffer.
+ *
+ * Lengths are in source pixels (see video_mode_source_width()), rounded down to
+ * whole words: multiples of 32 / bpp pixels, or any length in a h_pixel_double
+ * mode. The line is cut or padded with black to the mode's width.
+ *
+ * @param spans Array of VIDEO_OUTPUT_MAX_SPANS to fill
+ * @return Number of spans filled in
+ */
+typedef uint32_t (*video_output_span_cb_t)(uint32_t v_scanline, uint32_t active_line, video_span_t *spans);
+
+/**
+ * One horizontal window of an active line from the window callback: pixels read in
+ * place from another buffer.
+ */
+typedef struct {
+    const void *pixels; // Packed like a scanline buffer and 4-byte aligned; must stay valid until the line is sent
+    uint32_t width;     // Source pixels
+} video_window_t;
+
+/**
+ * Window Callback:
+ * Composes an active line from windows, left to right, each read from its own
+ * buffer: e.g. a 64-pixel status bar from one and the remaining 576 pixels from a
+ * scrolling playfield. With VIDEO_OUTPUT_VBLANK_CHAIN or VIDEO_OUTPUT_DI_ZERO_COPY
+ * the pixel DMA block becomes one segment per window, chained through control
+ * blocks, so no pixel is copied; without them the ISR copies the windows into a
+ * line buffer.
+ *
+ * Widths follow the span rules: whole words of source pixels (any width in a
+ * h_pixel_double mode), and the line is cut or padded with black to the mode's width.
+ *
+ * @param windows Array of VIDEO_OUTPUT_MAX_WINDOWS to fill
+ * @return Number of windows filled in
+ */
+typedef uint32_t (*video_output_window_cb_t)(uint32_t v_scanline, uint32_t active_line, video_window_t *windows);
+
+/**
+ * Select the timing mode: the command lists, ACR, AVI InfoFrame and audio
+ * schedule are built from it. Default: video_modes[VIDEO_MODE_640X480P60].
+ *
+ * Once video_output_core1_run() is running, the new mode is built into a spare
+ * configuration and the DMA ISR switches to it at the start of the next frame,
+ * without stopping the HSTX. Call from core 0, not from the vsync callback or
+ * another interrupt: building the configuration takes far longer than a line.
+ * It never waits: while a switch is still pending it returns false, and can be
+ * retried once video_output_switch_pending() is false. The pixel clock is
+ * clk_sys / 5, so a mode with a different pixel clock also needs
+ * set_sys_clock_khz() (see video_mode_sys_clock_khz()); the caller times that
+ * around the switch.
+ *
+ * @return false (keeping the current mode) if a mode switch is still pending,
+ *         the mode exceeds the VIDEO_OUTPUT_MAX_* limits, its blanking cannot
+ *         hold a data island or the pixel format cannot carry it (see
+ *         video_output_set_pixel_format())
+ */
+bool video_output_set_mode(const video_mode_t *mode);
+
+/**
+ * @return The timing mode being output (or to be output by video_output_init())
+ */
+const video_mode_t *video_output_get_mode(void);
+
+/**
+ * @return true while a mode or DVI/HDMI change is waiting for the next frame
+ */
+bool video_output_switch_pending(void);
+
 /**
  * Initialize HSTX and DMA for video output.
  * @param width Framebuffer width in pixels (e.g., 320)
@@ -62,6 +243,163 @@ void video_output_init(uint16_t width, uint16_t height);
  */
 void video_output_set_scanline_callback(video_output_scanline_cb_t cb);
 
+#if VIDEO_OUTPUT_LINE_CACHE_SIZE
+/**
+ * Register the cached scanline callback. While one is set it is used instead of
+ * the scanline callback; NULL goes back to the scanline callback.
+ */
+void video_output_set_cached_scanline_callback(video_output_cached_scanline_cb_t cb);
+
+/**
+ * @return Counts for the last complete frame. Read them from the vsync callback
+ *         for a consistent set.
+ */
+video_output_line_cache_stats_t video_output_line_cache_get_stats(void);
+#endif
+
+/**
+ * Register the span callback. While one is set it is used instead of the scanline
+ * callbacks; NULL goes back to them.
+ */
+void video_output_set_span_callback(video_output_span_cb_t cb);
+
+/**
+ * Register the window callback. While one is set it is used instead of the span
+ * and scanline callbacks; NULL goes back to them.
+ */
+void video_output_set_window_callback(video_output_window_cb_t cb);
+
+/**
+ * Select the pixel format of scanline buffers and framebuffer rows. The HSTX TMDS
+ * expander is reconfigured at the first active line of the next frame, so an 8 or
+ * 4 bpp buffer scans out with no conversion: a 640x480 framebuffer is 300 KB in
+ * RGB332 and 150 KB in Y4, against 600 KB in RGB565.
+ * Default: VIDEO_PIXEL_FORMAT_RGB565.
+ *
+ * @return false if a line of the selected mode is not a whole number of words in
+ *         the format, or the mode doubles pixels and the format has under 8 bpp
+ */
+bool video_output_set_pixel_format(video_pixel_format_t format);
+
+/**
+ * @return The pixel format most recently selected
+ */
+video_pixel_format_t video_output_get_pixel_format(void);
+
+/**
+ * Scan active video straight out of a framebuffer instead of calling the scanline
+ * callback. Each line's pixel block is a DMA read of a framebuffer row, so core 1
+ * touches no pixels. A row holds video_mode_source_width() pixels in the current
+ * pixel format and is sent on line_repeat consecutive lines, so a 480-line mode
+ * needs 480 / line_repeat rows (rounded up). Takes effect at the first active line
+ * of the next frame, where the last setting made before it is latched whole. Call
+ * the scan-out setters from one core. To change this and the pixel format in the
+ * same frame, call both from the vsync callback, which runs before that line.
+ *
+ * @param pixels First row, 4-byte aligned. NULL goes back to the scanline callback.
+ * @param stride_bytes Distance between rows, a multiple of 4
+ * @param line_repeat Output lines per row, at least 1
+ * @return false if the alignment or repeat count is invalid
+ */
+bool video_output_set_framebuffer(const void *pixels, uint32_t stride_bytes, uint32_t line_repeat);
+
+/**
+ * Queue a framebuffer to be scanned out from the next frame on, with the stride
+ * and line repeat of video_output_set_framebuffer(). The ISR flips to it at the
+ * first active line, so a frame never shows two buffers. A buffer presented while
+ * another still waits replaces it, so the waiting one is free again at once.
+ * That allows triple buffering: draw into a buffer that is neither the front nor
+ * the pending one, present it, and never wait. For double buffering, call
+ * video_output_wait_present() before drawing into the old front buffer.
+ * video_output_set_framebuffer() sets the front buffer directly and drops any
+ * earlier present. Presents only show while a framebuffer is set.
+ *
+ * @param pixels First row, 4-byte aligned
+ * @return false if pixels is NULL or misaligned
+ */
+bool video_output_present(const void *pixels);
+
+/**
+ * @return The framebuffer being scanned out this frame, or NULL
+ */
+const void *video_output_get_front_buffer(void);
+
+/**
+ * @return The buffer last presented, while it waits for its first frame; else NULL
+ */
+const void *video_output_get_pending_buffer(void);
+
+/**
+ * Wait until the buffer last presented is the front buffer. The buffer it
+ * replaced is then free. Returns at once if output is not running.
+ */
+void video_output_wait_present(void);
+
+/**
+ * Register a callback the ISR calls when the front buffer changes, at the first
+ * active line. It gets the buffer that was replaced, which the DMA has finished
+ * reading.
+ */
+void video_output_set_present_callback(video_output_present_cb_t cb);
+
+/**
+ * Show content smaller than the mode centred in it, e.g. 512x384 or 320x240 on
+ * 640x480 timing, with borders the HSTX makes from TMDS_REPEAT commands. Rows above
+ * and below the content go out as a border colour run with no callback. Content
+ * rows are sent as a left border, the content and a right border, so only the
+ * content is read from RAM: scanline buffers, framebuffer rows, windows, spans and
+ * ring lines are all width pixels wide, and active_line counts content rows from 0.
+ * Latched at the first active line of the next frame, like the framebuffer.
+ *
+ * Side borders need the control channels (VIDEO_OUTPUT_VBLANK_CHAIN or
+ * VIDEO_OUTPUT_DI_ZERO_COPY); without them only top and bottom borders are made.
+ *
+ * @param width Content width in source pixels, a whole number of words in the
+ *              current pixel format; 0 for the mode's full width
+ * @param height Content rows; 0 for all active lines
+ * @param colour Border colour in the current pixel format
+ * @return false if the content is larger than the selected mode, or its width is
+ *         not whole words
+ */
+bool video_output_set_letterbox(uint32_t width, uint32_t height, uint32_t colour);
+
+#if VIDEO_OUTPUT_LINE_RING_SIZE
+/**
+ * Send active video from the line ring instead of calling the scanline callback.
+ * Lines are rendered outside the ISR, on either core, through
+ * video_output_line_ring_acquire() and video_output_line_ring_commit(). The ISR only
+ * hands the DMA the buffer rendered for its line, so a renderer that keeps ahead
+ * has a whole line period per line instead of h-blank. A line with no buffer ready
+ * goes out black and is counted by video_output_line_ring_get_late(). Latched at
+ * the first active line of the next frame; a framebuffer takes precedence.
+ */
+void video_output_set_line_ring(bool enabled);
+
+/**
+ * Take the next free ring buffer and the line to render into it:
+ * video_mode_source_width() pixels in the current pixel format. Lines come in
+ * order. Lines the beam has already reached are skipped, and until the ring is in
+ * use the first one is line 0 of the next frame. Lines rendered ahead keep the
+ * format they were rendered in, so change the pixel format or mode with the ring
+ * disabled. Single producer.
+ *
+ * @param active_line Receives the active line (0 to v_active_lines - 1, or a
+ *                    letterbox content row)
+ * @return The buffer, or NULL if the ring is full or not enabled
+ */
+uint32_t *video_output_line_ring_acquire(uint32_t *active_line);
+
+/**
+ * Hand the buffer from the last video_output_line_ring_acquire() to the ISR.
+ */
+void video_output_line_ring_commit(void);
+
+/**
+ * @return Active lines sent black because their buffer was not ready in time
+ */
+uint32_t video_output_line_ring_get_late(void);
+#endif
+
 /**
  * Register a VSYNC callback, called once per frame at the start of vertical sync.
  */
@@ -83,6 +421,7 @@ bool video_output_get_dvi_mode(void);
  * Set DVI mode.
  * When enabled, disables all HDMI Data Islands (no audio output).
  * Some monitors have trouble syncing with HDMI Data Islands.
+ * Takes effect at the start of the next frame.
  * Default: false (HDMI mode with audio).
  * @param enabled true for DVI mode, false for HDMI mode with audio
  */
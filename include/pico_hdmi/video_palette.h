@@ -0,0 +1,85 @@
+#ifndef VIDEO_PALETTE_H
+#define VIDEO_PALETTE_H
+
+#include <stdint.h>
+
+// ============================================================================
+// Paletted Line Conversion
+// ============================================================================
+// Kernels for a scanline callback that keeps indexed-colour content and sends
+// RGB565. Each reads a whole word of indices at a time and writes pixel pairs
+// as 32-bit stores, with no per-pixel branches. They run from SRAM, leaving
+// scratch X to the DMA ISR and core 1's stack.
+//
+// Estimated Cortex-M33 cycles per line, from the inner loops' instruction counts
+// with the source, palette and line buffer in zero-wait-state RAM. These are
+// estimates, not measured on an RP2350:
+//
+//   Kernel                        640 px out   320 px out (h_pixel_double mode)
+//   video_palette_line_8bpp         ~2900        ~1450
+//   video_palette_line_8bpp_2x      ~1450          -
+//   video_palette_line_4bpp         ~1450         ~720
+//   video_palette_line_4bpp_2x      ~1200          -
+//
+// Against the ~800 cycles of h-blank at 126 MHz, only a 4 bpp source in a
+// h_pixel_double mode fits outright. The others rely on the line buffers being
+// double-buffered: the callback renders the next line while the DMA sends the
+// current one.
+
+/**
+ * Lookup tables for one palette, built by video_palette_set(). 2 KB; keep it in
+ * SRAM that core 1 can reach without contention, e.g. scratch Y.
+ */
+typedef struct {
+    uint32_t pair[256];    // Colour i in both halves: one 2x pixel, or half of a 1x pair
+    uint32_t nibbles[256]; // Byte b of a 4 bpp line: colour (b & 15), then colour (b >> 4)
+} video_palette_t;
+
+/**
+ * Build the tables from count RGB565 colours (at most 256; the rest are black).
+ * A 4 bpp source uses the first 16.
+ */
+void video_palette_set(video_palette_t *palette, const uint16_t *colours, uint32_t count);
+
+/**
+ * Change one colour, e.g. for palette animation from the vsync callback.
+ */
+void video_palette_set_colour(video_palette_t *palette, uint32_t index, uint16_t colour);
+
+/**
+ * 8 bpp indices to RGB565, one output pixel per index.
+ *
+ * @param dst Line buffer, receives pixels RGB565 pixels
+ * @param src Indices, 4-byte aligned
+ * @param pixels Source pixels, a multiple of 4
+ */
+void video_palette_line_8bpp(uint32_t *dst, const uint8_t *src, uint32_t pixels, const video_palette_t *palette);
+
+/**
+ * 8 bpp indices to RGB565, each index sent as two output pixels.
+ *
+ * @param dst Line buffer, receives 2 * pixels RGB565 pixels
+ * @param src Indices, 4-byte aligned
+ * @param pixels Source pixels, a multiple of 4
+ */
+void video_palette_line_8bpp_2x(uint32_t *dst, const uint8_t *src, uint32_t pixels, const video_palette_t *palette);
+
+/**
+ * 4 bpp indices (low nibble first) to RGB565, one output pixel per index.
+ *
+ * @param dst Line buffer, receives pixels RGB565 pixels
+ * @param src Indices, 4-byte aligned
+ * @param pixels Source pixels, a multiple of 8
+ */
+void video_palette_line_4bpp(uint32_t *dst, const uint8_t *src, uint32_t pixels, const video_palette_t *palette);
+
+/**
+ * 4 bpp indices (low nibble first) to RGB565, each index sent as two output pixels.
+ *
+ * @param dst Line buffer, receives 2 * pixels RGB565 pixels
+ * @param src Indices, 4-byte aligned
+ * @param pixels Source pixels, a multiple of 8
+ */
+void video_palette_line_4bpp_2x(uint32_t *dst, const uint8_t *src, uint32_t pixels, const video_palette_t *palette);
+
+#endif // VIDEO_PALETTE_H
@@ -0,0 +1,202 @@
+#include "pico_hdmi/hstx_audio_fifo.h"
+
+#include "pico_hdmi/hstx_data_island_queue.h"
+
+#include <string.h>
+
+#include "hardware/sync.h"
+
+// One slot is kept empty to tell full from empty. Sizes are multiples of 4, so
+// the consumer, which only moves whole packets, never splits a packet at the wrap.
+#define FIFO_SIZE (HSTX_AUDIO_FIFO_SAMPLES + 4)
+
+static audio_sample_t fifo[FIFO_SIZE];
+static volatile uint32_t fifo_head = 0; // Written by the producer
+static volatile uint32_t fifo_tail = 0; // Written by Core 1
+
+// ============================================================================
+// Low-Latency Rate Control
+// ============================================================================
+// Total buffering (FIFO plus queue) is held at ll_target by a linear-interpolating
+// resampler whose step is set by a PI loop on the low-passed buffer level. The
+// loop time constant is ~0.25 s; the integrator absorbs a steady clock offset.
+
+#define LL_QUEUE_PACKETS 4                // ~333 us in the Data Island queue
+#define LL_STEP_ONE (1 << 24)             // Resampler step/phase: Q24 input samples
+#define LL_MAX_ADJUST (LL_STEP_ONE / 100) // +/-1% rate correction
+#define LL_LEVEL_FILTER_SHIFT 7           // Level low-pass: ~11 ms at one update per packet
+#define LL_KP 6                           // Q24 step per Q8 sample of error (~0.9e-4 per sample)
+#define LL_INTEGRAL_SHIFT 12              // Integral time ~2 s
+
+static uint32_t ll_target = 0; // Samples; 0 = pass-through
+static bool ll_primed = false;
+static audio_sample_t rs_a, rs_b; // Output interpolates between these
+static uint32_t rs_phase;         // Q24 position between rs_a and rs_b
+static int32_t rs_adjust;         // Q24 step correction
+static int32_t rs_integral;       // Q24 << LL_INTEGRAL_SHIFT
+static int32_t rs_level_avg;      // Q8 samples buffered
+
+static void ll_reset(void)
+{
+    ll_primed = false;
+    rs_phase = 0;
+    rs_adjust = 0;
+    rs_integral = 0;
+}
+
+void hstx_audio_fifo_init(void)
+{
+    fifo_head = 0;
+    fifo_tail = 0;
+    ll_reset();
+}
+
+void hstx_audio_fifo_set_low_latency(uint32_t target_us)
+{
+    uint32_t target = (target_us * (HSTX_AUDIO_FIFO_RATE / 1000)) / 1000;
+    if (target > HSTX_AUDIO_FIFO_SAMPLES / 2)
+        target = HSTX_AUDIO_FIFO_SAMPLES / 2;
+    ll_target = target;
+    hstx_audio_fifo_init();
+}
+
+int32_t hstx_audio_fifo_get_rate_adjust_ppm(void)
+{
+    return (int32_t)(((int64_t)rs_adjust * 1000000) / LL_STEP_ONE);
+}
+
+uint32_t hstx_audio_fifo_get_level(void)
+{
+    return (fifo_head + FIFO_SIZE - fifo_tail) % FIFO_SIZE;
+}
+
+uint32_t hstx_audio_fifo_get_free(void)
+{
+    return FIFO_SIZE - 1 - hstx_audio_fifo_get_level();
+}
+
+uint32_t hstx_audio_fifo_write(const audio_sample_t *samples, uint32_t count)
+{
+    uint32_t space = hstx_audio_fifo_get_free();
+    if (count > space)
+        count = space;
+
+    uint32_t head = fifo_head;
+    uint32_t first = FIFO_SIZE - head;
+    if (first > count)
+        first = count;
+    memcpy(&fifo[head], samples, first * sizeof(audio_sample_t));
+    memcpy(&fifo[0], samples + first, (count - first) * sizeof(audio_sample_t));
+
+    // Samples must be visible to the other core before the new head
+    __dmb();
+    fifo_head = (head + count) % FIFO_SIZE;
+    return count;
+}
+
+static inline int16_t lerp(int16_t a, int16_t b, uint32_t phase)
+{
+    return (int16_t)(a + ((((int32_t)b - a) * (int32_t)(phase >> 9)) >> 15));
+}
+
+static void ll_update_rate(uint32_t buffered)
+{
+    rs_level_avg += ((int32_t)(buffered << 8) - rs_level_avg) >> LL_LEVEL_FILTER_SHIFT;
+    int32_t err = rs_level_avg - (int32_t)(ll_target << 8);
+
+    const int32_t integral_max = LL_MAX_ADJUST << LL_INTEGRAL_SHIFT;
+    rs_integral += err;
+    if (rs_integral > integral_max)
+        rs_integral = integral_max;
+    if (rs_integral < -integral_max)
+        rs_integral = -integral_max;
+
+    int32_t adjust = (err * LL_KP) + (rs_integral >> LL_INTEGRAL_SHIFT);
+    if (adjust > LL_MAX_ADJUST)
+        adjust = LL_MAX_ADJUST;
+    if (adjust < -LL_MAX_ADJUST)
+        adjust = -LL_MAX_ADJUST;
+    rs_adjust = adjust;
+}
+
+static void service_low_latency(void)
+{
+    uint32_t queued = hstx_di_queue_get_level();
+    uint32_t tail = fifo_tail;
+    uint32_t level = (fifo_head + FIFO_SIZE - tail) % FIFO_SIZE;
+
+    if (!ll_primed) {
+        // Fill to the target before starting, and again after an underrun
+        if (level + (queued * 4) < ll_target || level < 2)
+            return;
+        rs_a = fifo[tail];
+        rs_b = fifo[(tail + 1) % FIFO_SIZE];
+        tail = (tail + 2) % FIFO_SIZE;
+        level -= 2;
+        rs_phase = 0;
+        rs_level_avg = (int32_t)((level + (queued * 4)) << 8);
+        ll_primed = true;
+    }
+
+    while (queued < LL_QUEUE_PACKETS) {
+        // Four output samples consume at most five inputs at +1%
+        if (level < 5) {
+            if (queued == 0)
+                ll_primed = false;
+            break;
+        }
+        ll_update_rate(level + (queued * 4));
+
+        audio_sample_t out[4];
+        uint32_t step = (uint32_t)(LL_STEP_ONE + rs_adjust);
+        for (int i = 0; i < 4; i++) {
+            out[i].left = lerp(rs_a.left, rs_b.left, rs_phase);
+            out[i].right = lerp(rs_a.right, rs_b.right, rs_phase);
+            rs_phase += step;
+            while (rs_phase >= LL_STEP_ONE) {
+                rs_phase -= LL_STEP_ONE;
+                rs_a = rs_b;
+                rs_b = fifo[tail];
+                tail = (tail + 1) % FIFO_SIZE;
+                level--;
+            }
+        }
+        fifo_tail = tail;
+        hstx_di_queue_push_audio(out, 4);
+        queued++;
+    }
+    fifo_tail = tail;
+}
+
+void hstx_audio_fifo_service(void)
+{
+    if (ll_target) {
+        service_low_latency();
+        return;
+    }
+
+    uint32_t queued = hstx_di_queue_get_level();
+    if (queued >= HSTX_AUDIO_FIFO_QUEUE_PACKETS)
+        return;
+    uint32_t want = (HSTX_AUDIO_FIFO_QUEUE_PACKETS - queued) * 4;
+
+    uint32_t tail = fifo_tail;
+    uint32_t level = (fifo_head + FIFO_SIZE - tail) % FIFO_SIZE;
+    if (level > want)
+        level = want;
+
+    while (level >= 4) {
+        // Contiguous whole packets up to the end of the buffer
+        uint32_t run = FIFO_SIZE - tail;
+        if (run > level)
+            run = level;
+        run &= ~3u;
+
+        uint32_t n = hstx_di_queue_push_audio(&fifo[tail], run);
+        tail = (tail + n) % FIFO_SIZE;
+        fifo_tail = tail;
+        level -= n;
+        if (n < run)
+            break; // Data Island queue is full
+    }
+}
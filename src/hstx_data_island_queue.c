@@ -1,20 +1,61 @@
 #include "pico_hdmi/hstx_data_island_queue.h"
 
-#include "pico_hdmi/video_output.h"
-
 #include <string.h>
 
 #include "pico.h"
 
-#define DI_RING_BUFFER_SIZE 256
-static hstx_data_island_t di_ring_buffer[DI_RING_BUFFER_SIZE];
+#include "hardware/sync.h"
+
+#if HSTX_DI_QUEUE_LATE_ENCODE && HSTX_DI_QUEUE_ENCODE_AHEAD && (HSTX_DI_QUEUE_SIZE % HSTX_DI_QUEUE_ENCODE_AHEAD)
+#error "HSTX_DI_QUEUE_ENCODE_AHEAD must divide HSTX_DI_QUEUE_SIZE"
+#endif
+#if HSTX_DI_QUEUE_LATE_ENCODE && HSTX_DI_QUEUE_ENCODE_AHEAD == 1
+#error "HSTX_DI_QUEUE_ENCODE_AHEAD must be 0 or at least 2: the DMA may still be reading the last island"
+#endif
+
+#define DI_RING_BUFFER_SIZE HSTX_DI_QUEUE_SIZE
 static volatile uint32_t di_ring_head = 0;
 static volatile uint32_t di_ring_tail = 0;
+// Next packet the scheduler takes. Packets from the tail up to here have been taken
+// but not released: the DMA may still be reading them in place.
+static volatile uint32_t di_ring_read = 0;
+
+#if HSTX_DI_QUEUE_LATE_ENCODE
+// Raw packets; islands are encoded from here just before they are sent
+static hstx_packet_t di_packet_ring[DI_RING_BUFFER_SIZE];
+// hstx_di_queue_reserve() stages here; commit decodes it into the ring
+static hstx_data_island_t di_staged_island;
+static bool di_island_staged = false;
+#if HSTX_DI_QUEUE_ENCODE_AHEAD
+// Packet i is encoded into di_encoded[i % HSTX_DI_QUEUE_ENCODE_AHEAD]. Packets from
+// the tail up to (not including) di_encode_cursor are already encoded.
+static hstx_data_island_t di_encoded[HSTX_DI_QUEUE_ENCODE_AHEAD];
+static volatile uint32_t di_encode_cursor = 0;
+#else
+// Alternate, so the island just taken never overwrites one still held
+static hstx_data_island_t di_isr_island[2];
+#endif
+#else
+static hstx_data_island_t di_ring_buffer[DI_RING_BUFFER_SIZE];
+// hstx_di_queue_reserve_packet() stages here; commit encodes into the ring
+static hstx_packet_t di_staged_packet;
+static bool di_packet_staged = false;
+#endif
+
+// IEC 60958 frame counter for hstx_di_queue_push_audio()
+static int audio_frame_counter = 0;
+
+// Dry spells: the scheduler owed a packet and the queue was empty
+static uint32_t di_underruns = 0;
+static bool di_starved = true; // Until the first packet, silence is expected
 
 // Audio timing state (48kHz target)
 static uint32_t audio_sample_accum = 0; // Fixed-point accumulator
-#define SAMPLES_PER_FRAME (48000 / 60)
-#define SAMPLES_PER_LINE_FP ((SAMPLES_PER_FRAME << 16) / MODE_V_TOTAL_LINES)
+static uint32_t samples_per_line_fp = ((48000 / 60) << 16) / 525; // 640x480p60 until set
+
+// Sync arguments for hstx_encode_data_island(): where the mode's audio islands sit
+static bool island_vsync = false;
+static bool island_hsync = true;
 
 // Limit accumulator to avoid overflow if we run dry.
 // Clamping to 1 packet (plus a tiny margin is implicit) ensures we don't burst.
@@ -24,20 +65,157 @@ void hstx_di_queue_init(void)
 {
     di_ring_head = 0;
     di_ring_tail = 0;
+    di_ring_read = 0;
     audio_sample_accum = 0;
+    audio_frame_counter = 0;
+    di_underruns = 0;
+    di_starved = true;
+#if HSTX_DI_QUEUE_LATE_ENCODE && HSTX_DI_QUEUE_ENCODE_AHEAD
+    di_encode_cursor = 0;
+#endif
+}
+
+uint32_t hstx_di_queue_samples_per_line(uint32_t pixel_clock_khz, uint32_t h_total_pixels)
+{
+    return (uint32_t)(((uint64_t)48000 << 16) * h_total_pixels / ((uint64_t)pixel_clock_khz * 1000));
+}
+
+void __scratch_x("") hstx_di_queue_set_timing(uint32_t samples_per_line, bool vsync, bool hsync)
+{
+    samples_per_line_fp = samples_per_line;
+    island_vsync = vsync;
+    island_hsync = hsync;
+}
+
+// ============================================================================
+// Producer
+// ============================================================================
+
+static inline bool di_queue_full(void)
+{
+    return (di_ring_head + 1) % DI_RING_BUFFER_SIZE == di_ring_tail;
+}
+
+#if HSTX_DI_QUEUE_LATE_ENCODE
+
+hstx_data_island_t *hstx_di_queue_reserve(void)
+{
+    if (di_queue_full())
+        return NULL;
+    di_island_staged = true;
+    return &di_staged_island;
+}
+
+hstx_packet_t *hstx_di_queue_reserve_packet(void)
+{
+    if (di_queue_full())
+        return NULL;
+    return &di_packet_ring[di_ring_head];
+}
+
+void hstx_di_queue_commit(void)
+{
+    if (di_island_staged) {
+        di_island_staged = false;
+        if (!hstx_decode_data_island(&di_packet_ring[di_ring_head], &di_staged_island))
+            return;
+    }
+    // The slot must be fully written before the other core can see the new head
+    __dmb();
+    di_ring_head = (di_ring_head + 1) % DI_RING_BUFFER_SIZE;
 }
 
 bool hstx_di_queue_push(const hstx_data_island_t *island)
 {
-    uint32_t next_head = (di_ring_head + 1) % DI_RING_BUFFER_SIZE;
-    if (next_head == di_ring_tail)
+    if (di_queue_full() || !hstx_decode_data_island(&di_packet_ring[di_ring_head], island))
         return false;
+    hstx_di_queue_commit();
+    return true;
+}
 
-    di_ring_buffer[di_ring_head] = *island;
-    di_ring_head = next_head;
+#else
+
+hstx_data_island_t *hstx_di_queue_reserve(void)
+{
+    if (di_queue_full())
+        return NULL;
+    return &di_ring_buffer[di_ring_head];
+}
+
+hstx_packet_t *hstx_di_queue_reserve_packet(void)
+{
+    if (di_queue_full())
+        return NULL;
+    di_packet_staged = true;
+    return &di_staged_packet;
+}
+
+void hstx_di_queue_commit(void)
+{
+    if (di_packet_staged) {
+        hstx_encode_data_island(&di_ring_buffer[di_ring_head], &di_staged_packet, island_vsync, island_hsync);
+        di_packet_staged = false;
+    }
+    // The slot must be fully written before the other core can see the new head
+    __dmb();
+    di_ring_head = (di_ring_head + 1) % DI_RING_BUFFER_SIZE;
+}
+
+bool hstx_di_queue_push(const hstx_data_island_t *island)
+{
+    hstx_data_island_t *slot = hstx_di_queue_reserve();
+    if (!slot)
+        return false;
+
+    *slot = *island;
+    hstx_di_queue_commit();
     return true;
 }
 
+#endif
+
+bool hstx_di_queue_push_packet(const hstx_packet_t *packet)
+{
+    hstx_packet_t *slot = hstx_di_queue_reserve_packet();
+    if (!slot)
+        return false;
+
+    *slot = *packet;
+    hstx_di_queue_commit();
+    return true;
+}
+
+uint32_t hstx_di_queue_push_audio(const audio_sample_t *samples, uint32_t count)
+{
+    uint32_t packets = count / 4;
+    uint32_t space = DI_RING_BUFFER_SIZE - 1 - hstx_di_queue_get_level();
+    if (packets > space)
+        packets = space;
+
+    uint32_t head = di_ring_head;
+    for (uint32_t i = 0; i < packets; i++) {
+#if HSTX_DI_QUEUE_LATE_ENCODE
+        audio_frame_counter = hstx_packet_set_audio_samples(&di_packet_ring[head], samples, 4, audio_frame_counter);
+#else
+        hstx_packet_t packet;
+        audio_frame_counter = hstx_packet_set_audio_samples(&packet, samples, 4, audio_frame_counter);
+        hstx_encode_data_island(&di_ring_buffer[head], &packet, island_vsync, island_hsync);
+#endif
+        samples += 4;
+        head = (head + 1) % DI_RING_BUFFER_SIZE;
+
+        // Publish each packet so the scheduler never waits on the whole block
+        __dmb();
+        di_ring_head = head;
+    }
+    return packets * 4;
+}
+
+uint32_t hstx_di_queue_get_underruns(void)
+{
+    return di_underruns;
+}
+
 uint32_t hstx_di_queue_get_level(void)
 {
     uint32_t head = di_ring_head;
@@ -47,21 +225,78 @@ uint32_t hstx_di_queue_get_level(void)
     return DI_RING_BUFFER_SIZE + head - tail;
 }
 
+// ============================================================================
+// Scheduler (Core 1)
+// ============================================================================
+
+void hstx_di_queue_encode_ahead(void)
+{
+#if HSTX_DI_QUEUE_LATE_ENCODE && HSTX_DI_QUEUE_ENCODE_AHEAD
+    while (true) {
+        uint32_t e = di_encode_cursor;
+        if (e == di_ring_head || (e + DI_RING_BUFFER_SIZE - di_ring_tail) % DI_RING_BUFFER_SIZE >=
+                                     HSTX_DI_QUEUE_ENCODE_AHEAD)
+            return;
+
+        // Encode aside: if the ISR catches up meanwhile, it encodes this island
+        // itself and the DMA may already be reading di_encoded
+        hstx_data_island_t island;
+        hstx_encode_data_island(&island, &di_packet_ring[e], island_vsync, island_hsync);
+
+        uint32_t save = save_and_disable_interrupts();
+        if (di_encode_cursor == e) {
+            di_encoded[e % HSTX_DI_QUEUE_ENCODE_AHEAD] = island;
+            di_encode_cursor = (e + 1) % DI_RING_BUFFER_SIZE;
+        }
+        restore_interrupts(save);
+    }
+#endif
+}
+
 void __scratch_x("") hstx_di_queue_tick(void)
 {
-    audio_sample_accum += SAMPLES_PER_LINE_FP;
+    audio_sample_accum += samples_per_line_fp;
+}
+
+static inline const uint32_t *__scratch_x("") di_queue_take(uint32_t index)
+{
+#if HSTX_DI_QUEUE_LATE_ENCODE && HSTX_DI_QUEUE_ENCODE_AHEAD
+    hstx_data_island_t *island = &di_encoded[index % HSTX_DI_QUEUE_ENCODE_AHEAD];
+    if (di_encode_cursor == index) {
+        // The Core 1 loop has not got this far; encode it now
+        hstx_encode_data_island(island, &di_packet_ring[index], island_vsync, island_hsync);
+        di_encode_cursor = (index + 1) % DI_RING_BUFFER_SIZE;
+    } else {
+        // Encoded ahead, possibly before a mode change
+        hstx_data_island_set_sync(island, island_vsync, island_hsync);
+    }
+    return island->words;
+#elif HSTX_DI_QUEUE_LATE_ENCODE
+    hstx_data_island_t *island = &di_isr_island[index & 1];
+    hstx_encode_data_island(island, &di_packet_ring[index], island_vsync, island_hsync);
+    return island->words;
+#else
+    // Encoded by the producer, possibly before a mode change
+    hstx_data_island_set_sync(&di_ring_buffer[index], island_vsync, island_hsync);
+    return di_ring_buffer[index].words;
+#endif
 }
 
-const uint32_t *__scratch_x("") hstx_di_queue_get_audio_packet(void)
+const uint32_t *__scratch_x("") hstx_di_queue_take_audio_packet(void)
 {
     // Check if it's time to send a 4-sample audio packet (every ~2.6 lines)
     if (audio_sample_accum >= (4 << 16)) {
-        if (di_ring_tail != di_ring_head) {
+        if (di_ring_read != di_ring_head) {
             audio_sample_accum -= (4 << 16);
-            const uint32_t *words = di_ring_buffer[di_ring_tail].words;
-            di_ring_tail = (di_ring_tail + 1) % DI_RING_BUFFER_SIZE;
+            const uint32_t *words = di_queue_take(di_ring_read);
+            di_ring_read = (di_ring_read + 1) % DI_RING_BUFFER_SIZE;
+            di_starved = false;
             return words;
         } // Queue is empty but we owe samples.
+        if (!di_starved) {
+            di_underruns++;
+            di_starved = true;
+        }
         // Clamp accumulator to prevent 32-bit overflow during long silence.
         // Also prevents bursting when data returns.
         if (audio_sample_accum > MAX_AUDIO_ACCUM) {
@@ -70,3 +305,16 @@ const uint32_t *__scratch_x("") hstx_di_queue_get_audio_packet(void)
     }
     return NULL;
 }
+
+void __scratch_x("") hstx_di_queue_release_audio_packet(void)
+{
+    di_ring_tail = (di_ring_tail + 1) % DI_RING_BUFFER_SIZE;
+}
+
+const uint32_t *hstx_di_queue_get_audio_packet(void)
+{
+    const uint32_t *words = hstx_di_queue_take_audio_packet();
+    if (words)
+        hstx_di_queue_release_audio_packet();
+    return words;
+}
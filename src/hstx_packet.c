@@ -2,6 +2,8 @@
 
 #include <string.h>
 
+#include "pico.h"
+
 // ============================================================================
 // TERC4 Symbol Table (4-bit to 10-bit encoding)
 // ============================================================================
@@ -57,11 +59,6 @@ static inline bool compute_parity(uint8_t v)
     return (parity_table[v / 8] >> (v % 8)) & 1;
 }
 
-static inline bool compute_parity3(uint8_t a, uint8_t b, uint8_t c)
-{
-    return compute_parity(a) ^ compute_parity(b) ^ compute_parity(c);
-}
-
 static uint8_t encode_bch_3(const uint8_t *p)
 {
     uint8_t v = bch_table[p[0]];
@@ -70,16 +67,46 @@ static uint8_t encode_bch_3(const uint8_t *p)
     return v;
 }
 
-static uint8_t encode_bch_7(const uint8_t *p)
+// Slicing tables: bch_slice[i][b] is the ECC contribution of byte b at position i of a
+// 7-byte subpacket, so the seven lookups are independent instead of one serial chain.
+// The last row is bch_table itself.
+static uint8_t bch_slice[7][256];
+
+// The audio sample subpacket ECC and parity folded into one lookup per PCM byte. Rows are
+// left low, left high, right low, right high; each entry is (ECC << 8) | d[6] contribution.
+// Even parity is linear in the sample bits, so its effect on the ECC folds in with it.
+static uint16_t audio_sample_bch[4][256];
+
+static bool bch_tables_initialized = false;
+
+static void init_bch_tables(void)
 {
-    uint8_t v = bch_table[p[0]];
-    v = bch_table[p[1] ^ v];
-    v = bch_table[p[2] ^ v];
-    v = bch_table[p[3] ^ v];
-    v = bch_table[p[4] ^ v];
-    v = bch_table[p[5] ^ v];
-    v = bch_table[p[6] ^ v];
-    return v;
+    if (bch_tables_initialized)
+        return;
+    for (int b = 0; b < 256; b++) {
+        uint8_t v = bch_table[b];
+        bch_slice[6][b] = v;
+        for (int i = 5; i >= 0; i--) {
+            v = bch_table[v];
+            bch_slice[i][b] = v;
+        }
+    }
+    static const int position[4] = {1, 2, 4, 5};
+    for (int row = 0; row < 4; row++) {
+        uint8_t parity_bit = row < 2 ? 0x08 : 0x80;
+        for (int b = 0; b < 256; b++) {
+            uint8_t d6 = compute_parity((uint8_t)b) ? parity_bit : 0;
+            uint8_t ecc = bch_slice[position[row]][b] ^ bch_slice[6][d6];
+            audio_sample_bch[row][b] = (uint16_t)((ecc << 8) | d6);
+        }
+    }
+    bch_tables_initialized = true;
+}
+
+static inline uint8_t encode_bch_7(const uint8_t *p)
+{
+    return bch_slice[0][p[0]] ^ bch_slice[1][p[1]] ^ bch_slice[2][p[2]] ^ bch_slice[3][p[3]] ^ bch_slice[4][p[4]] ^
+           bch_slice[5][p[5]] ^ bch_slice[6][p[6]];
 }
 
 static void compute_header_parity(hstx_packet_t *p)
@@ -89,15 +116,21 @@ static void compute_header_parity(hstx_packet_t *p)
 
 static void compute_subpacket_parity(hstx_packet_t *p, int idx)
 {
+    init_bch_tables();
     p->subpacket[idx][7] = encode_bch_7(p->subpacket[idx]);
 }
 
 static void compute_all_parity(hstx_packet_t *p)
 {
+    init_bch_tables();
     compute_header_parity(p);
-    for (int i = 0; i < 4; i++) {
-        compute_subpacket_parity(p, i);
-    }
+
+    // All 28 lookups are independent, so the four subpackets overlap in the pipeline
+    uint8_t ecc[4];
+    for (int i = 0; i < 4; i++)
+        ecc[i] = encode_bch_7(p->subpacket[i]);
+    for (int i = 0; i < 4; i++)
+        p->subpacket[i][7] = ecc[i];
 }
 
 static void compute_infoframe_checksum(hstx_packet_t *p)
@@ -124,6 +157,11 @@ void hstx_packet_init(hstx_packet_t *packet)
     memset(packet, 0, sizeof(hstx_packet_t));
 }
 
+void hstx_packet_compute_parity(hstx_packet_t *packet)
+{
+    compute_all_parity(packet);
+}
+
 void hstx_packet_set_null(hstx_packet_t *packet)
 {
     hstx_packet_init(packet);
@@ -196,118 +234,150 @@ void hstx_packet_set_avi_infoframe(hstx_packet_t *packet, uint8_t vic)
 int hstx_packet_set_audio_samples(hstx_packet_t *packet, const audio_sample_t *samples, int num_samples,
                                   int frame_count)
 {
+    init_bch_tables();
     hstx_packet_init(packet);
     if (num_samples < 1)
         num_samples = 1;
     if (num_samples > 4)
         num_samples = 4;
 
-    uint8_t sample_present = (1 << num_samples) - 1;
-    uint8_t b_flags = 0;
-
-    int temp_frame_count = frame_count;
-    for (int i = 0; i < num_samples; i++) {
-        if (temp_frame_count == 0)
-            b_flags |= (1 << i);
-        temp_frame_count = (temp_frame_count + 1) % 192;
-    }
+    // The B flag marks the sample that starts a 192-frame block
+    unsigned b_index = frame_count ? 192u - (unsigned)frame_count : 0;
+    uint8_t b_flags = b_index < (unsigned)num_samples ? (uint8_t)(1u << b_index) : 0;
 
     packet->header[0] = 0x02;
-    packet->header[1] = sample_present;
+    packet->header[1] = (1 << num_samples) - 1;
     packet->header[2] = b_flags << 4;
     compute_header_parity(packet);
 
+    // Subpacket bytes are {0, L lo, L hi, 0, R lo, R hi, parity, ECC}: built as two
+    // little-endian words, with parity and ECC from one lookup per PCM byte
     for (int i = 0; i < num_samples; i++) {
-        uint8_t *d = packet->subpacket[i];
-        int16_t left = samples[i].left;
-        int16_t right = samples[i].right;
-
-        d[0] = 0x00;
-        d[1] = left & 0xFF;
-        d[2] = (left >> 8) & 0xFF;
-        d[3] = 0x00;
-        d[4] = right & 0xFF;
-        d[5] = (right >> 8) & 0xFF;
-
-        bool p_left = compute_parity3(d[1], d[2], 0);
-        bool p_right = compute_parity3(d[4], d[5], 0);
-
-        d[6] = (p_left << 3) | (p_right << 7);
-        compute_subpacket_parity(packet, i);
+        uint16_t left = (uint16_t)samples[i].left;
+        uint16_t right = (uint16_t)samples[i].right;
+        uint32_t tail = audio_sample_bch[0][left & 0xFF] ^ audio_sample_bch[1][left >> 8] ^
+                        audio_sample_bch[2][right & 0xFF] ^ audio_sample_bch[3][right >> 8];
+        uint32_t words[2] = {(uint32_t)left << 8, right | (tail << 16)};
+        memcpy(packet->subpacket[i], words, sizeof(words));
     }
 
-    return temp_frame_count;
+    return (frame_count + num_samples) % 192;
 }
 
-static inline uint32_t make_hstx_word(uint16_t lane0, uint16_t lane1, uint16_t lane2)
-{
-    return (lane0 & 0x3FF) | ((lane1 & 0x3FF) << 10) | ((lane2 & 0x3FF) << 20);
-}
+// ============================================================================
+// TERC4 Data Island Encoder
+// ============================================================================
+
+// Lanes 1 and 2 for one pixel clock, indexed by (lane2 nibble << 4) | lane1 nibble,
+// already shifted into HSTX word position
+static uint32_t terc4_lane12[256];
 
-static void encode_header_to_lane0(const hstx_packet_t *packet, uint16_t *lane0, int hv, bool first_packet)
+// Spreads the bit pairs of a subpacket byte across four pixel clocks: bit 2k goes to
+// bit 8k (lane 1) and bit 2k+1 to bit 8k+4 (lane 2). OR-ing the spreads of the four
+// subpackets, shifted by the subpacket index, gives one terc4_lane12 index per byte.
+static uint32_t subpacket_spread[256];
+
+static bool terc4_tables_initialized = false;
+
+static void init_terc4_tables(void)
 {
-    int hv1 = hv | 0x08;
-    if (!first_packet)
-        hv = hv1;
-
-    int idx = 0;
-    for (int i = 0; i < 4; i++) {
-        uint8_t h = packet->header[i];
-        lane0[idx++] = ter_c4[((h << 2) & 4) | hv];
-        hv = hv1;
-        lane0[idx++] = ter_c4[((h << 1) & 4) | hv];
-        lane0[idx++] = ter_c4[(h & 4) | hv];
-        lane0[idx++] = ter_c4[((h >> 1) & 4) | hv];
-        lane0[idx++] = ter_c4[((h >> 2) & 4) | hv];
-        lane0[idx++] = ter_c4[((h >> 3) & 4) | hv];
-        lane0[idx++] = ter_c4[((h >> 4) & 4) | hv];
-        lane0[idx++] = ter_c4[((h >> 5) & 4) | hv];
+    if (terc4_tables_initialized)
+        return;
+    for (int i = 0; i < 256; i++) {
+        terc4_lane12[i] = ((uint32_t)ter_c4[i & 0xF] << 10) | ((uint32_t)ter_c4[i >> 4] << 20);
+
+        uint32_t spread = 0;
+        for (int k = 0; k < 4; k++) {
+            spread |= (uint32_t)((i >> (2 * k)) & 1) << (8 * k);
+            spread |= (uint32_t)((i >> (2 * k + 1)) & 1) << (8 * k + 4);
+        }
+        subpacket_spread[i] = spread;
     }
+    terc4_tables_initialized = true;
 }
 
-static void encode_subpackets_to_lanes(const hstx_packet_t *packet, uint16_t *lane1, uint16_t *lane2)
+// In RAM: with late queue encoding this can run in the DMA ISR
+void __not_in_flash_func(hstx_encode_data_island)(hstx_data_island_t *out, const hstx_packet_t *packet,
+                                                  bool vsync_active, bool hsync_active)
 {
+    // REVERTED: vsync_active/hsync_active indicate pulse region, not signal level
+    // For 640x480 (negative polarity), pulse region means signal=0
+    int hv = (vsync_active ? 0 : 2) | (hsync_active ? 0 : 1);
+    init_terc4_tables();
+
+    // Lane 0 carries one header bit per clock in D2; D3 is clear only on the first clock
+    const uint32_t l0[2] = {ter_c4[0x8 | hv], ter_c4[0xC | hv]};
+    uint32_t guard_word = ter_c4[0xC | hv] | (GUARD_BAND_SYMBOL << 10) | (GUARD_BAND_SYMBOL << 20);
+
+    uint32_t *w = out->words;
+    w[0] = guard_word;
+    w[1] = guard_word;
+    w += 2;
+
     for (int i = 0; i < 8; i++) {
-        uint32_t v = (packet->subpacket[0][i] << 0) | (packet->subpacket[1][i] << 8) | (packet->subpacket[2][i] << 16) |
-                     (packet->subpacket[3][i] << 24);
-        uint32_t t = (v ^ (v >> 7)) & 0x00aa00aa;
-        v = v ^ t ^ (t << 7);
-        t = (v ^ (v >> 14)) & 0x0000cccc;
-        v = v ^ t ^ (t << 14);
-
-        lane1[(i * 4) + 0] = ter_c4[(v >> 0) & 0xF];
-        lane1[(i * 4) + 1] = ter_c4[(v >> 16) & 0xF];
-        lane1[(i * 4) + 2] = ter_c4[(v >> 4) & 0xF];
-        lane1[(i * 4) + 3] = ter_c4[(v >> 20) & 0xF];
-
-        lane2[(i * 4) + 0] = ter_c4[(v >> 8) & 0xF];
-        lane2[(i * 4) + 1] = ter_c4[(v >> 24) & 0xF];
-        lane2[(i * 4) + 2] = ter_c4[(v >> 12) & 0xF];
-        lane2[(i * 4) + 3] = ter_c4[(v >> 28) & 0xF];
+        uint32_t v = subpacket_spread[packet->subpacket[0][i]] | (subpacket_spread[packet->subpacket[1][i]] << 1) |
+                     (subpacket_spread[packet->subpacket[2][i]] << 2) | (subpacket_spread[packet->subpacket[3][i]] << 3);
+        uint32_t h = packet->header[i / 2] >> ((i & 1) * 4);
+
+        w[0] = l0[(h >> 0) & 1] | terc4_lane12[v & 0xFF];
+        w[1] = l0[(h >> 1) & 1] | terc4_lane12[(v >> 8) & 0xFF];
+        w[2] = l0[(h >> 2) & 1] | terc4_lane12[(v >> 16) & 0xFF];
+        w[3] = l0[(h >> 3) & 1] | terc4_lane12[v >> 24];
+        w += 4;
     }
+    // The first packet clock has D3 clear
+    out->words[2] = (out->words[2] & ~0x3FFu) | ter_c4[((packet->header[0] & 1) << 2) | hv];
+
+    w[0] = guard_word;
+    w[1] = guard_word;
 }
 
-void hstx_encode_data_island(hstx_data_island_t *out, const hstx_packet_t *packet, bool vsync_active, bool hsync_active)
+// Lane 0 carries hsync and vsync in TERC4 bits 0 and 1. Cheap when the island already matches.
+void __not_in_flash_func(hstx_data_island_set_sync)(hstx_data_island_t *island, bool vsync_active, bool hsync_active)
 {
-    // REVERTED: vsync_active/hsync_active indicate pulse region, not signal level
-    // For 640x480 (negative polarity), pulse region means signal=0
     int hv = (vsync_active ? 0 : 2) | (hsync_active ? 0 : 1);
-    uint16_t lane0[32];
-    uint16_t lane1[32];
-    uint16_t lane2[32];
-
-    encode_header_to_lane0(packet, lane0, hv, true);
-    encode_subpackets_to_lanes(packet, lane1, lane2);
-
-    uint16_t gb_lane0 = ter_c4[0xC | hv];
-    uint32_t guard_word = make_hstx_word(gb_lane0, GUARD_BAND_SYMBOL, GUARD_BAND_SYMBOL);
-
-    out->words[0] = guard_word;
-    out->words[1] = guard_word;
-    for (int i = 0; i < 32; i++)
-        out->words[i + 2] = make_hstx_word(lane0[i], lane1[i], lane2[i]);
-    out->words[34] = guard_word;
-    out->words[35] = guard_word;
+    if ((island->words[0] & 0x3FFu) == ter_c4[0xC | hv])
+        return;
+
+    for (int i = 0; i < W_DATA_ISLAND; i++) {
+        uint32_t symbol = island->words[i] & 0x3FFu;
+        int d = 0;
+        while (d < 15 && ter_c4[d] != symbol)
+            d++;
+        island->words[i] = (island->words[i] & ~0x3FFu) | ter_c4[(d & 0xC) | hv];
+    }
+}
+
+// TERC4 symbol to its 4-bit value, or -1
+static int terc4_value(uint32_t symbol)
+{
+    for (int d = 0; d < 16; d++) {
+        if (ter_c4[d] == symbol)
+            return d;
+    }
+    return -1;
+}
+
+// The inverse of hstx_encode_data_island(), clock by clock
+bool hstx_decode_data_island(hstx_packet_t *out, const hstx_data_island_t *island)
+{
+    hstx_packet_t packet = {0};
+    for (int c = 0; c < W_DATA_PACKET; c++) {
+        uint32_t word = island->words[W_GUARDBAND + c];
+        int l0 = terc4_value(word & 0x3FFu);
+        int l1 = terc4_value((word >> 10) & 0x3FFu);
+        int l2 = terc4_value((word >> 20) & 0x3FFu);
+        if (l0 < 0 || l1 < 0 || l2 < 0)
+            return false;
+
+        // Header bit c in D2 of lane 0; subpacket n's bit pair in bit n of lanes 1 and 2
+        packet.header[c / 8] |= (uint8_t)(((l0 >> 2) & 1) << (c % 8));
+        int i = c / 4, j = c % 4;
+        for (int n = 0; n < 4; n++)
+            packet.subpacket[n][i] |= (uint8_t)((((l1 >> n) & 1) << (2 * j)) | (((l2 >> n) & 1) << (2 * j + 1)));
+    }
+    *out = packet;
+    return true;
 }
 
 static hstx_data_island_t null_islands[4];
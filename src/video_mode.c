@@ -0,0 +1,77 @@
+#include "pico_hdmi/video_mode.h"
+
+// Timings from CEA-861 (VIC 1, 2), VESA DMT (800x600) and VESA CVT-RB (1280x720)
+const video_mode_t video_modes[VIDEO_MODE_COUNT] = {
+    [VIDEO_MODE_640X480P60] =
+        {
+            .name = "640x480",
+            .pixel_clock_khz = 25200,
+            .h_front_porch = 16,
+            .h_sync_width = 96,
+            .h_back_porch = 48,
+            .h_active_pixels = 640,
+            .v_front_porch = 10,
+            .v_sync_width = 2,
+            .v_back_porch = 33,
+            .v_active_lines = 480,
+            .vic = 1,
+        },
+    [VIDEO_MODE_720X480P60] =
+        {
+            .name = "720x480",
+            .pixel_clock_khz = 27000,
+            .h_front_porch = 16,
+            .h_sync_width = 62,
+            .h_back_porch = 60,
+            .h_active_pixels = 720,
+            .v_front_porch = 9,
+            .v_sync_width = 6,
+            .v_back_porch = 30,
+            .v_active_lines = 480,
+            .vic = 2,
+        },
+    [VIDEO_MODE_800X600P60] =
+        {
+            .name = "800x600",
+            .pixel_clock_khz = 40000,
+            .h_front_porch = 40,
+            .h_sync_width = 128,
+            .h_back_porch = 88,
+            .h_active_pixels = 800,
+            .v_front_porch = 1,
+            .v_sync_width = 4,
+            .v_back_porch = 23,
+            .v_active_lines = 600,
+            .h_sync_positive = true,
+            .v_sync_positive = true,
+        },
+    [VIDEO_MODE_1280X720P60_RB] =
+        {
+            .name = "1280x720",
+            .pixel_clock_khz = 64000,
+            .h_front_porch = 48,
+            .h_sync_width = 32,
+            .h_back_porch = 80,
+            .h_active_pixels = 1280,
+            .v_front_porch = 3,
+            .v_sync_width = 5,
+            .v_back_porch = 13,
+            .v_active_lines = 720,
+            .h_sync_positive = true,
+        },
+    [VIDEO_MODE_320X480P60] =
+        {
+            .name = "320x480",
+            .pixel_clock_khz = 25200,
+            .h_front_porch = 16,
+            .h_sync_width = 96,
+            .h_back_porch = 48,
+            .h_active_pixels = 640,
+            .v_front_porch = 10,
+            .v_sync_width = 2,
+            .v_back_porch = 33,
+            .v_active_lines = 480,
+            .vic = 1,
+            .h_pixel_double = true,
+        },
+};
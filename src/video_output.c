@@ -1,5 +1,6 @@
 #include "pico_hdmi/video_output.h"
 
+#include "pico_hdmi/hstx_audio_fifo.h"
 #include "pico_hdmi/hstx_data_island_queue.h"
 #include "pico_hdmi/hstx_packet.h"
 #include "pico_hdmi/hstx_pins.h"
@@ -12,6 +13,7 @@
 #include "hardware/structs/bus_ctrl.h"
 #include "hardware/structs/hstx_ctrl.h"
 #include "hardware/structs/hstx_fifo.h"
+#include "hardware/sync.h"
 
 #include <math.h>
 #include <string.h>
@@ -25,21 +27,17 @@
 #define TMDS_CTRL_10 0x154u // vsync=1 hsync=0
 #define TMDS_CTRL_11 0x2abu // vsync=1 hsync=1
 
-// Sync symbols: Lane 0 carries sync, Lanes 1&2 are always CTRL_00
-#define SYNC_V0_H0 (TMDS_CTRL_00 | (TMDS_CTRL_00 << 10) | (TMDS_CTRL_00 << 20))
-#define SYNC_V0_H1 (TMDS_CTRL_01 | (TMDS_CTRL_00 << 10) | (TMDS_CTRL_00 << 20))
-#define SYNC_V1_H0 (TMDS_CTRL_10 | (TMDS_CTRL_00 << 10) | (TMDS_CTRL_00 << 20))
-#define SYNC_V1_H1 (TMDS_CTRL_11 | (TMDS_CTRL_00 << 10) | (TMDS_CTRL_00 << 20))
+// Lanes 1&2 of the control period words. Lane 0 carries sync, in the mode's polarity (see sync_word()).
+// Sync: Lanes 1&2 are always CTRL_00
+#define SYNC_LANES_12 ((TMDS_CTRL_00 << 10) | (TMDS_CTRL_00 << 20))
 
-// Data Island preamble: Lane 0 = sync, Lanes 1&2 = CTRL_01 pattern
+// Data Island preamble: Lanes 1&2 = CTRL_01 pattern
 // Per HDMI 1.3a Table 5-2: CTL0=1, CTL1=0, CTL2=1, CTL3=0
-#define PREAMBLE_V0_H0 (TMDS_CTRL_00 | (TMDS_CTRL_01 << 10) | (TMDS_CTRL_01 << 20))
-#define PREAMBLE_V1_H0 (TMDS_CTRL_10 | (TMDS_CTRL_01 << 10) | (TMDS_CTRL_01 << 20))
+#define DI_PREAMBLE_LANES_12 ((TMDS_CTRL_01 << 10) | (TMDS_CTRL_01 << 20))
 
-// Video preamble: Lane 0 = sync, Lane 1 = CTRL_01, Lane 2 = CTRL_00
+// Video preamble: Lane 1 = CTRL_01, Lane 2 = CTRL_00
 // Per HDMI 1.3a Table 5-2: CTL0=1, CTL1=0, CTL2=0, CTL3=0
-#define VIDEO_PREAMBLE_V0_H1 (TMDS_CTRL_01 | (TMDS_CTRL_01 << 10) | (TMDS_CTRL_00 << 20))
-#define VIDEO_PREAMBLE_V1_H1 (TMDS_CTRL_11 | (TMDS_CTRL_01 << 10) | (TMDS_CTRL_00 << 20))
+#define VIDEO_PREAMBLE_LANES_12 ((TMDS_CTRL_01 << 10) | (TMDS_CTRL_00 << 20))
 
 // Video guard band: Per HDMI 1.3a Table 5-5
 // CH0 = 0b1011001100 (0x2CC), CH1 = 0b0100110011 (0x133), CH2 = 0b1011001100 (0x2CC)
@@ -51,7 +49,11 @@
 #define HSTX_CMD_TMDS_REPEAT (0x3u << 12)
 #define HSTX_CMD_NOP (0xfu << 12)
 
-#define SYNC_AFTER_DI (MODE_H_SYNC_WIDTH - W_PREAMBLE - W_DATA_ISLAND)
+// Called as soon as the IRQ handler has given the finished channel its next block.
+// The host emulator defines it to time IRQ entry to reprogram.
+#ifndef VIDEO_OUTPUT_DMA_REPROGRAMMED
+#define VIDEO_OUTPUT_DMA_REPROGRAMMED() ((void)0)
+#endif
 
 // Video preamble and guard band widths (HDMI 1.3a Section 5.2.2)
 #define W_VIDEO_PREAMBLE 8
@@ -69,282 +71,953 @@ volatile uint32_t video_frame_count = 0;
 // Some monitors have trouble syncing with HDMI Data Islands
 static bool dvi_mode = false; // Default to HDMI mode (full features with audio)
 
-static uint16_t line_buffer[MODE_H_ACTIVE_PIXELS] __attribute__((aligned(4)));
+// A line of the widest mode at 16 bpp, or the command list built from a full set of spans
+#define LINE_BUFFER_WORDS (VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS / 2 + 2 * VIDEO_OUTPUT_MAX_SPANS + 2)
+
+// Two line buffers: the callback renders the next line while the DMA is still reading the current one
+static uint32_t line_buffer[2][LINE_BUFFER_WORDS];
+static uint32_t line_buffer_idx = 0;
+// Pixel block of the active line whose command list was posted last
+static const uint32_t *active_pixels = NULL;
+static uint32_t active_transfers = 0;
+static bool active_narrow = false;
 static uint32_t v_scanline = 2;
 static bool vactive_cmdlist_posted = false;
 static bool dma_pong = false;
 
 static video_output_task_fn background_task = NULL;
 static video_output_scanline_cb_t scanline_callback = NULL;
+static video_output_span_cb_t span_callback = NULL;
+static video_span_t spans[VIDEO_OUTPUT_MAX_SPANS];
+static video_output_window_cb_t window_callback = NULL;
+static video_window_t windows[VIDEO_OUTPUT_MAX_WINDOWS];
 static video_output_vsync_cb_t vsync_callback = NULL;
 
+// Framebuffer scan-out and pixel format. video_output_set_framebuffer() and
+// video_output_set_pixel_format() publish a descriptor and the ISR latches it at the
+// first active line, so a frame never mixes two of them.
+typedef struct {
+    const uint32_t *pixels;      // First row, or NULL to render with the scanline callback
+    uint32_t stride_words;       // Distance between rows
+    uint32_t line_repeat;        // Output lines per row
+    video_pixel_format_t format; // Of the scanline buffers and framebuffer rows
+    uint32_t letterbox_width;    // Content width in source pixels, 0 for the full line
+    uint32_t letterbox_height;   // Content rows, 0 for every active line
+    uint32_t border_colour;
+    uint32_t framebuffer_serial; // Bumped by video_output_set_framebuffer()
+    uint32_t present_count;      // Presents it supersedes
+#if VIDEO_OUTPUT_LINE_RING_SIZE
+    bool line_ring; // Without a framebuffer: send lines rendered ahead into the ring
+#endif
+} scanout_t;
+
+static scanout_t scanouts[2];
+static const scanout_t *volatile scanout = &scanouts[0];
+// The descriptor the ISR is copying, which the setters must not overwrite meanwhile
+static const scanout_t *volatile scanout_latching = NULL;
+static scanout_t scan; // Latched for the current frame
+static const uint32_t *scan_row;
+static uint32_t scan_repeat_left;
+
+// video_output_present(): the buffer last presented, published before the count.
+// The ISR takes it at the first active line once the count has moved on.
+static const uint32_t *volatile present_next = NULL;
+static volatile uint32_t present_count = 0;
+static volatile uint32_t present_taken = 0;
+static const uint32_t *volatile front_buffer = NULL;
+static uint32_t front_serial = 0; // framebuffer_serial front_buffer was last set from
+static video_output_present_cb_t present_callback = NULL;
+
+#if VIDEO_OUTPUT_LINE_RING_SIZE
+#if VIDEO_OUTPUT_LINE_RING_SIZE < 4
+#error "VIDEO_OUTPUT_LINE_RING_SIZE must be 0 or at least 4"
+#endif
+
+// A line's position in the ring: frame number in the top 16 bits, active line below.
+// Positions are compared by signed difference, so the frame number can wrap.
+#define RING_POS(frame, line) (((uint32_t)(frame) << 16) | (line))
+
+static uint16_t line_ring_buffer[VIDEO_OUTPUT_LINE_RING_SIZE][VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS]
+    __attribute__((aligned(4)));
+static uint32_t line_ring_pos[VIDEO_OUTPUT_LINE_RING_SIZE]; // Line each slot was rendered for
+// Slots from free to tail were taken by the ISR and may still be read by the DMA,
+// tail to head are rendered and waiting, and head is the one the producer fills.
+static volatile uint32_t line_ring_head = 0;
+static volatile uint32_t line_ring_tail = 0;
+static volatile uint32_t line_ring_free = 0;
+static uint32_t line_ring_frame = 0;           // ISR: frames started
+static volatile uint32_t line_ring_beam = 0;   // Position of the active line posted last
+static volatile bool line_ring_active = false; // Latched for the current frame
+static volatile uint32_t line_ring_late = 0;
+static uint32_t line_ring_next = 0; // Producer: position to render next
+#endif
+
+#if VIDEO_OUTPUT_LINE_CACHE_SIZE
+#if VIDEO_OUTPUT_LINE_CACHE_SIZE < 2
+#error "VIDEO_OUTPUT_LINE_CACHE_SIZE must be 0 or at least 2"
+#endif
+
+static video_output_cached_scanline_cb_t cached_scanline_callback = NULL;
+static uint32_t line_cache[VIDEO_OUTPUT_LINE_CACHE_SIZE][VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS / 2];
+// Active lines of this frame each buffer was drawn for and last sent for; UINT32_MAX if neither
+static uint32_t line_cache_drawn[VIDEO_OUTPUT_LINE_CACHE_SIZE];
+static uint32_t line_cache_sent[VIDEO_OUTPUT_LINE_CACHE_SIZE];
+static uint32_t line_cache_last = 0; // Buffer of the previous line, which the DMA may still be reading
+static video_output_line_cache_stats_t line_cache_frame; // Counting this frame
+static video_output_line_cache_stats_t line_cache_stats; // Last complete frame
+#endif
+
 #define DMACH_PING 0
 #define DMACH_PONG 1
+// Control channels: each writes control blocks into its own data channel (PING + 2, PONG + 2)
+#define DMACH_PING_CTRL 2
+#define DMACH_PONG_CTRL 3
 
-// ============================================================================
-// Command Lists
-// ============================================================================
-
-// Pure DVI command lists (no Data Islands)
-static uint32_t vblank_line_vsync_off[] = {HSTX_CMD_RAW_REPEAT | MODE_H_FRONT_PORCH,
-                                           SYNC_V1_H1,
-                                           HSTX_CMD_NOP,
-                                           HSTX_CMD_RAW_REPEAT | MODE_H_SYNC_WIDTH,
-                                           SYNC_V1_H0,
-                                           HSTX_CMD_NOP,
-                                           HSTX_CMD_RAW_REPEAT | (MODE_H_BACK_PORCH + MODE_H_ACTIVE_PIXELS),
-                                           SYNC_V1_H1,
-                                           HSTX_CMD_NOP};
-
-static uint32_t vblank_line_vsync_on[] = {HSTX_CMD_RAW_REPEAT | MODE_H_FRONT_PORCH,
-                                          SYNC_V0_H1,
-                                          HSTX_CMD_NOP,
-                                          HSTX_CMD_RAW_REPEAT | MODE_H_SYNC_WIDTH,
-                                          SYNC_V0_H0,
-                                          HSTX_CMD_NOP,
-                                          HSTX_CMD_RAW_REPEAT | (MODE_H_BACK_PORCH + MODE_H_ACTIVE_PIXELS),
-                                          SYNC_V0_H1,
-                                          HSTX_CMD_NOP};
-
-// Active video line for DVI mode (no Data Island, just sync + pixels)
-static uint32_t vactive_line_dvi[] = {
-    HSTX_CMD_RAW_REPEAT | MODE_H_FRONT_PORCH, SYNC_V1_H1, HSTX_CMD_NOP,
-    HSTX_CMD_RAW_REPEAT | MODE_H_SYNC_WIDTH,  SYNC_V1_H0, HSTX_CMD_NOP,
-    HSTX_CMD_RAW_REPEAT | MODE_H_BACK_PORCH,  SYNC_V1_H1, HSTX_CMD_TMDS | MODE_H_ACTIVE_PIXELS};
-
-static uint32_t vactive_di_ping[128], vactive_di_pong[128], vactive_di_null[128];
-static uint32_t vactive_di_len, vactive_di_null_len;
-
-static uint32_t vblank_di_ping[128], vblank_di_pong[128], vblank_di_null[128];
-static uint32_t vblank_di_len, vblank_di_null_len;
-
-static uint32_t vblank_acr_vsync_on[64], vblank_acr_vsync_on_len;
-static uint32_t vblank_acr_vsync_off[64], vblank_acr_vsync_off_len;
-static uint32_t vblank_infoframe_vsync_on[64], vblank_infoframe_vsync_on_len;
-static uint32_t vblank_infoframe_vsync_off[64], vblank_infoframe_vsync_off_len;
-static uint32_t vblank_avi_infoframe[64], vblank_avi_infoframe_len;
+#define DMA_CTRL_CHANNELS (VIDEO_OUTPUT_VBLANK_CHAIN || VIDEO_OUTPUT_DI_ZERO_COPY)
 
 // ============================================================================
-// HSTX Resync - Reset output to sync with input VSYNC
+// Scanline Action Table
 // ============================================================================
+// Everything the ISR needs to know about a scanline, resolved once per mode, so
+// the handler does a single indexed load instead of classifying v_scanline.
+// With VIDEO_OUTPUT_VBLANK_CHAIN, consecutive blanking lines with no CPU work are
+// posted as one run and played from control blocks without further IRQs.
 
-static void __scratch_x("") hstx_resync(void)
-{
-    // 1. Abort DMA chains
-    dma_channel_abort(DMACH_PING);
-    dma_channel_abort(DMACH_PONG);
+#define SCANLINE_TICK (1u << 0)   // Advance the Data Island scheduler
+#define SCANLINE_AUDIO (1u << 1)  // Send the next audio island in place of cmd if one is due
+#define SCANLINE_ACTIVE (1u << 2) // Render the line; its pixels follow as a second DMA block
+#define SCANLINE_FRAME (1u << 3)  // First vsync line: count the frame and run the vsync callback
 
-    // 2. Disable HSTX (resets shift register, clock generator, and flushes FIFO)
-    hstx_ctrl_hw->csr &= ~HSTX_CTRL_CSR_EN_BITS;
+// How a line's command list ends. A span line, and any line of a letterbox with
+// borders on that line, leaves out the final TMDS command: its pixel block brings
+// commands of its own.
+enum { LINE_BLANK, LINE_ACTIVE, LINE_SPANS, LINE_KINDS };
 
-    // Small delay to ensure HSTX fully stops
-    __asm volatile("nop\nnop\nnop\nnop");
+typedef struct {
+    const uint32_t *cmd; // Command list for the line
+    uint16_t len;        // Length of cmd in words
+    uint8_t flags;       // SCANLINE_*
+    uint8_t run;         // Following static lines the control channel plays after this one
+} scanline_action_t;
+
+// A DMA control block, laid out like a channel's first register alias (READ_ADDR,
+// WRITE_ADDR, TRANS_COUNT, CTRL_TRIG). The control channel writes each one into the
+// data channel through a write ring, so it is padded to a power-of-two size.
+typedef struct __attribute__((aligned(4 * sizeof(uintptr_t)))) {
+    uintptr_t read_addr;
+    uintptr_t write_addr;
+    uint32_t transfer_count;
+    uint32_t ctrl;
+} dma_cb_t;
 
-    // 3. Reset state to start of frame
-    v_scanline = 0;
-    vactive_cmdlist_posted = false;
-    dma_pong = false;
+typedef struct {
+    scanline_action_t actions[VIDEO_OUTPUT_MAX_V_TOTAL_LINES];
+#if VIDEO_OUTPUT_VBLANK_CHAIN
+    // Control block for each blanking line that is played inside a run, one set per
+    // data channel: the last line of a run hands back to the other channel
+    dma_cb_t run_cbs[2][VIDEO_OUTPUT_MAX_V_BLANK_LINES];
+#endif
+} scanline_table_t;
+
+// PING/PONG CTRL values: a normal block (chain to the other channel, IRQ at the end)
+// and one followed by control blocks (chain to its control channel, no IRQ)
+static uint32_t dma_ctrl_line[2];
+#if DMA_CTRL_CHANNELS
+static uint32_t dma_ctrl_run[2];
+#endif
+
+// A channel whose last block was doubled pixels, still set for narrow transfers
+static bool ctrl_narrow[2];
+
+#if DMA_CTRL_CHANNELS
+// A pixel block sent in segments: left border, windows, padding, right border. One
+// set per line in turn, since the previous line's pixel block may still be reading
+// the other. The first is copied into the data channel by the ISR, the rest by its
+// control channel.
+static dma_cb_t segment_cbs[2][VIDEO_OUTPUT_MAX_WINDOWS + 3];
+static uint32_t segment_set = 0;
+// Set with the pixel block of the active line whose command list was posted last
+static const dma_cb_t *active_cbs = NULL;
+#endif
+
+#if VIDEO_OUTPUT_DI_ZERO_COPY
+// The island each channel is sending, released back to the queue on its next IRQ
+static bool di_held[2];
+#endif
 
-    // 4. Clear any pending DMA interrupts
-    dma_hw->ints0 = (1U << DMACH_PING) | (1U << DMACH_PONG);
+// ============================================================================
+// Video Configuration
+// ============================================================================
+// Everything built from a mode: resolved timing, command lists and scanline tables.
 
-    // 5. Configure DMA PING to start from beginning of frame (Line 0)
-    dma_channel_hw_t *ch_ping = &dma_hw->ch[DMACH_PING];
-    ch_ping->read_addr = (uintptr_t)vblank_line_vsync_off;
-    ch_ping->transfer_count = count_of(vblank_line_vsync_off);
+// Pure DVI command lists (no Data Islands): front porch, sync, back porch (and pixels)
+#define DVI_LINE_WORDS 9
 
-    // 6. Configure DMA PONG for the NEXT line (Line 1)
-    // This ensures that when PING finishes and chains to PONG, PONG is ready.
-    dma_channel_hw_t *ch_pong = &dma_hw->ch[DMACH_PONG];
-    ch_pong->read_addr = (uintptr_t)vblank_line_vsync_off; // Line 1 is also blank
-    ch_pong->transfer_count = count_of(vblank_line_vsync_off);
+// How the expander and the pixel block read one pixel format in a mode
+typedef struct {
+    bool valid; // A line is whole words, and doubling has a transfer size to use
+    uint32_t expand_tmds;
+    uint32_t expand_shift;
+    uint32_t line_words;      // Scanline buffer length
+    uint32_t pixel_transfers; // Pixel block length
+    bool narrow;              // Doubled pixels: the block uses dma_ctrl, one pixel per transfer
+    uint32_t dma_ctrl[2];     // Pixel block CTRL: dma_ctrl_line, narrowed when doubled
+#if DMA_CTRL_CHANNELS
+    uint32_t dma_ctrl_run[2]; // The same, followed by window control blocks
+#endif
+    uint32_t bpp;
+    uint32_t width;          // Source pixels per line
+    uint32_t span_unit;      // Source pixels per word of a span line
+    uint32_t span_replicate; // Multiplier that fills a word with one pixel
+} pixel_layout_t;
 
-    // 7. Re-enable HSTX then start DMA
-    hstx_ctrl_hw->csr |= HSTX_CTRL_CSR_EN_BITS;
-    dma_channel_start(DMACH_PING);
-}
+typedef struct {
+    const video_mode_t *mode;
+    uint32_t v_total_lines;
+    uint32_t v_active_start; // First active line
+    bool di_in_hsync;        // Islands sit in the hsync pulse, else at the start of the back porch
+    // Words before the island in a line from build_line_with_di()
+    uint32_t di_line_island_offset;
+
+    // Data Island queue timing: audio rate and the sync arguments of its islands
+    uint32_t samples_per_line;
+    bool di_vsync;
+    bool di_hsync;
+
+    uint32_t vblank_line_vsync_off[DVI_LINE_WORDS];
+    uint32_t vblank_line_vsync_on[DVI_LINE_WORDS];
+    // Active video line for DVI mode (no Data Island, just sync + pixels)
+    uint32_t vactive_line_dvi[DVI_LINE_WORDS];
+
+    uint32_t vactive_di_null[128], vactive_di_null_len;
+    uint32_t vblank_di_null[128], vblank_di_null_len;
+
+    uint32_t vblank_acr_vsync_on[64], vblank_acr_vsync_on_len;
+    uint32_t vblank_acr_vsync_off[64], vblank_acr_vsync_off_len;
+    uint32_t vblank_infoframe_vsync_on[64], vblank_infoframe_vsync_on_len;
+    uint32_t vblank_infoframe_vsync_off[64], vblank_infoframe_vsync_off_len;
+    uint32_t vblank_avi_infoframe[64], vblank_avi_infoframe_len;
+
+    pixel_layout_t layouts[VIDEO_PIXEL_FORMAT_COUNT];
+
+    scanline_table_t hdmi;
+    scanline_table_t dvi;
+
+#if VIDEO_OUTPUT_DI_ZERO_COPY
+    // An audio line is sent in three segments: the null-island line's prefix, the
+    // island read in place from the queue slot, then the null-island line's suffix.
+    // [channel][line kind][island, suffix]; the ISR only fills in the island address.
+    dma_cb_t di_cbs[2][LINE_KINDS][2];
+#endif
+} video_config_t;
+
+// Two configurations, so video_output_set_mode() can build the next one while the
+// ISR plays the other. The ISR swaps them at line 0 and the HSTX never stops.
+static video_config_t configs[2];
+static video_config_t *volatile config = &configs[0];
+
+// Handed to the ISR for the next line 0. It stays set until the frame line, by
+// which time nothing of the old configuration is left in flight.
+static video_config_t *volatile pending_config = NULL;
+
+// Mode video_output_init() builds
+static const video_mode_t *selected_mode = &video_modes[VIDEO_MODE_640X480P60];
+static bool output_running = false;
+
+// Switched as a whole at line 0, so the ISR never sees a mixed table
+static const scanline_table_t *scanline_table = &configs[0].hdmi;
+
+// Latched with the scan-out descriptor at the first active line
+static const pixel_layout_t *layout = &configs[0].layouts[VIDEO_PIXEL_FORMAT_RGB565];
+
+// Borders around content smaller than the mode, latched with the layout
+typedef struct {
+    uint32_t top;       // First content row, as an active line
+    uint32_t rows;      // Content rows; the active lines around them are border
+    uint32_t width;     // Content width, in source pixels
+    bool sides;         // Content rows go out between a left and a right border
+    uint32_t cmds[5];   // Left border and the content's TMDS command, then the right border
+    uint32_t border[2]; // Pixel block of a border row
+} letterbox_t;
+
+static letterbox_t letterbox;
+// The latched layout narrowed to the content, while there are side borders
+static pixel_layout_t letterbox_layout;
+
+#if !VIDEO_OUTPUT_DI_ZERO_COPY
+// Lines carrying an audio island are built here, one buffer per DMA channel: a
+// channel's buffer is only rewritten once that channel has finished reading it
+static uint32_t di_line_buf[2][128];
+#endif
 
 // ============================================================================
 // Internal Helpers
 // ============================================================================
 
-static uint32_t build_line_with_di(uint32_t *buf, const uint32_t *di_words, bool vsync, bool active)
+// A control period word with lane 0 at the sync levels for the given pulse states
+static uint32_t sync_word(const video_mode_t *mode, bool vsync, bool hsync, uint32_t lanes_12)
 {
-    uint32_t *p = buf;
-    uint32_t sync_h0 = vsync ? SYNC_V0_H0 : SYNC_V1_H0;
-    uint32_t sync_h1 = vsync ? SYNC_V0_H1 : SYNC_V1_H1;
-    uint32_t preamble = vsync ? PREAMBLE_V0_H0 : PREAMBLE_V1_H0;
+    static const uint32_t lane0[4] = {TMDS_CTRL_00, TMDS_CTRL_01, TMDS_CTRL_10, TMDS_CTRL_11};
+    uint32_t v = vsync == mode->v_sync_positive;
+    uint32_t h = hsync == mode->h_sync_positive;
+    return lane0[(v << 1) | h] | lanes_12;
+}
 
-    *p++ = HSTX_CMD_RAW_REPEAT | MODE_H_FRONT_PORCH;
-    *p++ = sync_h1;
+static uint32_t *put_run(uint32_t *p, uint32_t count, uint32_t word)
+{
+    *p++ = HSTX_CMD_RAW_REPEAT | count;
+    *p++ = word;
     *p++ = HSTX_CMD_NOP;
+    return p;
+}
 
-    *p++ = HSTX_CMD_RAW_REPEAT | W_PREAMBLE;
-    *p++ = preamble;
-    *p++ = HSTX_CMD_NOP;
+// Whether the line buffers, scanline tables and line layouts can carry a mode
+static bool mode_fits(const video_mode_t *m)
+{
+    const uint32_t island = W_PREAMBLE + W_DATA_ISLAND;
+    const uint32_t video_lead = W_VIDEO_PREAMBLE + W_VIDEO_GUARD_BAND;
+    const uint32_t v_total = video_mode_v_total(m);
+
+    // Every run must be non-empty and within RAW_REPEAT's 12-bit count. The island
+    // goes in the hsync pulse if it fits, else ahead of the video preamble.
+    bool h_ok = m->h_active_pixels && !(video_mode_source_width(m) & 1) &&
+                m->h_active_pixels <= VIDEO_OUTPUT_MAX_H_ACTIVE_PIXELS && m->h_front_porch && m->h_sync_width &&
+                m->h_back_porch > video_lead && m->h_back_porch + m->h_active_pixels < 4096 &&
+                (m->h_sync_width > island || m->h_back_porch > island + video_lead);
+    // The frame starts with the AVI InfoFrame line, and the back porch needs a line for ACR
+    bool v_ok = m->v_active_lines && v_total <= VIDEO_OUTPUT_MAX_V_TOTAL_LINES &&
+                v_total - m->v_active_lines <= VIDEO_OUTPUT_MAX_V_BLANK_LINES && m->v_front_porch &&
+                m->v_sync_width && m->v_back_porch >= 4;
+    return h_ok && v_ok;
+}
+
+// Whether a line of the mode is whole words in the format, and doubling has a transfer size to use
+static bool format_fits(const video_mode_t *m, video_pixel_format_t format)
+{
+    const uint32_t bpp = video_pixel_format_bpp(format);
+    return !((video_mode_source_width(m) * bpp) % 32) && (!m->h_pixel_double || bpp >= 8);
+}
+
+static void build_dvi_line(const video_config_t *cfg, uint32_t *buf, bool vsync, bool active)
+{
+    const video_mode_t *mode = cfg->mode;
+    uint32_t *p = buf;
+    uint32_t idle = sync_word(mode, vsync, false, SYNC_LANES_12);
+
+    p = put_run(p, mode->h_front_porch, idle);
+    p = put_run(p, mode->h_sync_width, sync_word(mode, vsync, true, SYNC_LANES_12));
+    if (active) {
+        *p++ = HSTX_CMD_RAW_REPEAT | mode->h_back_porch;
+        *p++ = idle;
+        *p++ = HSTX_CMD_TMDS | mode->h_active_pixels;
+    } else {
+        put_run(p, mode->h_back_porch + mode->h_active_pixels, idle);
+    }
+}
+
+static uint32_t build_line_with_di(const video_config_t *cfg, uint32_t *buf, const uint32_t *di_words, bool vsync,
+                                   bool active)
+{
+    const video_mode_t *mode = cfg->mode;
+    uint32_t *p = buf;
+    uint32_t idle = sync_word(mode, vsync, false, SYNC_LANES_12);
+    uint32_t pulse = sync_word(mode, vsync, true, SYNC_LANES_12);
+    uint32_t back_porch = mode->h_back_porch;
+
+    p = put_run(p, mode->h_front_porch, idle);
+    if (!cfg->di_in_hsync) {
+        p = put_run(p, mode->h_sync_width, pulse);
+        back_porch -= W_PREAMBLE + W_DATA_ISLAND;
+    }
+
+    p = put_run(p, W_PREAMBLE, sync_word(mode, vsync, cfg->di_in_hsync, DI_PREAMBLE_LANES_12));
 
     *p++ = HSTX_CMD_RAW | W_DATA_ISLAND;
     for (int i = 0; i < W_DATA_ISLAND; i++)
         *p++ = di_words[i];
     *p++ = HSTX_CMD_NOP;
 
-    *p++ = HSTX_CMD_RAW_REPEAT | SYNC_AFTER_DI;
-    *p++ = sync_h0;
-    *p++ = HSTX_CMD_NOP;
+    if (cfg->di_in_hsync)
+        p = put_run(p, mode->h_sync_width - W_PREAMBLE - W_DATA_ISLAND, pulse);
 
     if (active) {
         // HDMI 1.3a Section 5.2.2: Video Data Period requires preamble and guard band
-        uint32_t video_preamble = vsync ? VIDEO_PREAMBLE_V0_H1 : VIDEO_PREAMBLE_V1_H1;
 
         // Control period (back porch minus preamble and guard band)
-        *p++ = HSTX_CMD_RAW_REPEAT | (MODE_H_BACK_PORCH - W_VIDEO_PREAMBLE - W_VIDEO_GUARD_BAND);
-        *p++ = sync_h1;
-        *p++ = HSTX_CMD_NOP;
+        p = put_run(p, back_porch - W_VIDEO_PREAMBLE - W_VIDEO_GUARD_BAND, idle);
 
         // Video Preamble (8 pixels)
-        *p++ = HSTX_CMD_RAW_REPEAT | W_VIDEO_PREAMBLE;
-        *p++ = video_preamble;
-        *p++ = HSTX_CMD_NOP;
+        p = put_run(p, W_VIDEO_PREAMBLE, sync_word(mode, vsync, false, VIDEO_PREAMBLE_LANES_12));
 
         // Video Guard Band (2 pixels)
         *p++ = HSTX_CMD_RAW_REPEAT | W_VIDEO_GUARD_BAND;
         *p++ = VIDEO_GUARD_BAND;
 
         // Active video pixels
-        *p++ = HSTX_CMD_TMDS | MODE_H_ACTIVE_PIXELS;
+        *p++ = HSTX_CMD_TMDS | mode->h_active_pixels;
     } else {
-        *p++ = HSTX_CMD_RAW_REPEAT | (MODE_H_BACK_PORCH + MODE_H_ACTIVE_PIXELS);
-        *p++ = sync_h1;
-        *p++ = HSTX_CMD_NOP;
+        p = put_run(p, back_porch + mode->h_active_pixels, idle);
     }
     return (uint32_t)(p - buf);
 }
 
-typedef struct {
-    bool vsync_active;
-    bool front_porch;
-    bool back_porch;
-    bool active_video;
-    bool send_acr;
-    uint32_t active_line;
-} scanline_state_t;
-
-static inline void __scratch_x("") get_scanline_state(uint32_t v_scanline, scanline_state_t *state)
-{
-    state->vsync_active = (v_scanline >= MODE_V_FRONT_PORCH && v_scanline < (MODE_V_FRONT_PORCH + MODE_V_SYNC_WIDTH));
-    state->front_porch = (v_scanline < MODE_V_FRONT_PORCH);
-    state->back_porch = (v_scanline >= MODE_V_FRONT_PORCH + MODE_V_SYNC_WIDTH &&
-                         v_scanline < MODE_V_FRONT_PORCH + MODE_V_SYNC_WIDTH + MODE_V_BACK_PORCH);
-    state->active_video = (!state->vsync_active && !state->front_porch && !state->back_porch);
-
-    state->send_acr = (v_scanline >= (MODE_V_FRONT_PORCH + MODE_V_SYNC_WIDTH) &&
-                       v_scanline < (MODE_V_TOTAL_LINES - MODE_V_ACTIVE_LINES) && (v_scanline % 4 == 0));
-
-    if (state->active_video) {
-        state->active_line = v_scanline - (MODE_V_TOTAL_LINES - MODE_V_ACTIVE_LINES);
-    } else {
-        state->active_line = 0;
+// ============================================================================
+// Building a Configuration
+// ============================================================================
+
+static void set_action(scanline_action_t *action, const uint32_t *cmd, uint32_t len, uint32_t flags)
+{
+    action->cmd = cmd;
+    action->len = (uint16_t)len;
+    action->flags = (uint8_t)flags;
+    action->run = 0;
+}
+
+static dma_channel_config line_dma_config(uint channel, uint chain_to)
+{
+    dma_channel_config c = dma_channel_get_default_config(channel);
+    channel_config_set_chain_to(&c, chain_to);
+    channel_config_set_dreq(&c, DREQ_HSTX);
+    return c;
+}
+
+// Bits and right rotation of each channel: the rotation brings the channel's top bit to bit 7
+#define EXPAND_TMDS(r_bits, r_rot, g_bits, g_rot, b_bits, b_rot)                                                      \
+    (((r_bits) - 1) << HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB | (r_rot) << HSTX_CTRL_EXPAND_TMDS_L2_ROT_LSB |            \
+     ((g_bits) - 1) << HSTX_CTRL_EXPAND_TMDS_L1_NBITS_LSB | (g_rot) << HSTX_CTRL_EXPAND_TMDS_L1_ROT_LSB |            \
+     ((b_bits) - 1) << HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB | (b_rot) << HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB)
+
+static const uint32_t format_expand_tmds[VIDEO_PIXEL_FORMAT_COUNT] = {
+    [VIDEO_PIXEL_FORMAT_RGB565] = EXPAND_TMDS(5, 8, 6, 3, 5, 29),
+    [VIDEO_PIXEL_FORMAT_RGB555] = EXPAND_TMDS(5, 7, 5, 2, 5, 29),
+    [VIDEO_PIXEL_FORMAT_RGB332] = EXPAND_TMDS(3, 0, 3, 29, 2, 26),
+    [VIDEO_PIXEL_FORMAT_Y4] = EXPAND_TMDS(4, 28, 4, 28, 4, 28),
+};
+
+static void build_layout(const video_mode_t *mode, video_pixel_format_t format, pixel_layout_t *l)
+{
+    const uint32_t bpp = video_pixel_format_bpp(format);
+    uint32_t n_shifts = 32 / bpp;
+
+    l->valid = format_fits(mode, format);
+    l->expand_tmds = format_expand_tmds[format];
+    l->line_words = (video_mode_source_width(mode) * bpp) / 32;
+    l->pixel_transfers = l->line_words;
+    l->narrow = mode->h_pixel_double;
+    l->bpp = bpp;
+    l->width = video_mode_source_width(mode);
+    // A span line goes out in whole words; doubled, each word is one source pixel twice
+    l->span_unit = mode->h_pixel_double ? 1 : n_shifts;
+    l->span_replicate = 0xffffffffu / ((1u << bpp) - 1);
+    if (l->narrow) {
+        // A narrow write reaches the FIFO replicated across the word, and the expander
+        // shifts out the first two copies: each pixel goes out twice
+        n_shifts = 2;
+        l->pixel_transfers = video_mode_source_width(mode);
     }
+    for (uint ch = 0; ch < 2; ch++) {
+        dma_channel_config c = line_dma_config(ch, ch ^ 1);
+        if (l->narrow)
+            channel_config_set_transfer_data_size(&c, bpp == 8 ? DMA_SIZE_8 : DMA_SIZE_16);
+        l->dma_ctrl[ch] = channel_config_get_ctrl_value(&c);
+#if DMA_CTRL_CHANNELS
+        channel_config_set_chain_to(&c, DMACH_PING_CTRL + ch);
+        channel_config_set_irq_quiet(&c, true);
+        l->dma_ctrl_run[ch] = channel_config_get_ctrl_value(&c);
+#endif
+    }
+    l->expand_shift =
+        n_shifts << HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB | bpp << HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB |
+        1 << HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_LSB | 0 << HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_LSB;
 }
 
-static inline void __scratch_x("") video_output_handle_vsync(dma_channel_hw_t *ch, uint32_t v_scanline)
+#if VIDEO_OUTPUT_VBLANK_CHAIN
+// Group consecutive blanking lines that need no CPU work into runs. A run may start,
+// but not continue, on the frame line: its vsync callback runs when the run is posted.
+// The frame line is posted as the line before it starts, so that line is a block of
+// its own: the callback comes one line ahead of vsync, as with one IRQ per line.
+static void build_runs(const video_config_t *cfg, scanline_table_t *table)
 {
-    if (dvi_mode) {
-        // Pure DVI: simple vsync line without Data Islands
-        ch->read_addr = (uintptr_t)vblank_line_vsync_on;
-        ch->transfer_count = count_of(vblank_line_vsync_on);
-        if (v_scanline == MODE_V_FRONT_PORCH) {
-            video_frame_count++;
-            if (vsync_callback)
-                vsync_callback();
+    const uint32_t dynamic = SCANLINE_AUDIO | SCANLINE_ACTIVE;
+    const uint32_t active_start = cfg->v_active_start;
+    const uint32_t before_frame = cfg->mode->v_front_porch - 1;
+    uint32_t line = 0;
+    while (line < active_start) {
+        uint32_t end = line + 1;
+        if (!(table->actions[line].flags & dynamic) && line != before_frame) {
+            while (end < active_start && end != before_frame &&
+                   !(table->actions[end].flags & (dynamic | SCANLINE_FRAME)))
+                end++;
         }
-    } else {
-        if (v_scanline == MODE_V_FRONT_PORCH) {
-            ch->read_addr = (uintptr_t)vblank_acr_vsync_on;
-            ch->transfer_count = vblank_acr_vsync_on_len;
-            video_frame_count++;
-            if (vsync_callback)
-                vsync_callback();
-        } else {
-            ch->read_addr = (uintptr_t)vblank_infoframe_vsync_on;
-            ch->transfer_count = vblank_infoframe_vsync_on_len;
+        table->actions[line].run = (uint8_t)(end - line - 1);
+
+        for (uint32_t ch = 0; ch < 2; ch++) {
+            for (uint32_t l = line + 1; l < end; l++) {
+                dma_cb_t *cb = &table->run_cbs[ch][l];
+                cb->read_addr = (uintptr_t)table->actions[l].cmd;
+                cb->write_addr = (uintptr_t)&hstx_fifo_hw->fifo;
+                cb->transfer_count = table->actions[l].len;
+                cb->ctrl = l == end - 1 ? dma_ctrl_line[ch] : dma_ctrl_run[ch];
+            }
         }
+        line = end;
     }
 }
+#endif
 
-static inline void __scratch_x("")
-    video_output_handle_active_start(dma_channel_hw_t *ch, uint32_t v_scanline, uint32_t active_line, bool dma_pong)
+static void build_scanline_tables(video_config_t *cfg)
 {
-    uint32_t *dst32 = (uint32_t *)line_buffer;
-
-    if (scanline_callback) {
-        scanline_callback(v_scanline, active_line, dst32);
-    } else {
-        // If no callback, just output black pixels
-        for (uint32_t i = 0; i < MODE_H_ACTIVE_PIXELS / 2; i++) {
-            dst32[i] = 0;
+    const video_mode_t *mode = cfg->mode;
+    const uint32_t vsync_start = mode->v_front_porch;
+    const uint32_t back_porch_start = mode->v_front_porch + mode->v_sync_width;
+    const uint32_t active_start = cfg->v_active_start;
+
+    for (uint32_t line = 0; line < cfg->v_total_lines; line++) {
+        scanline_action_t *dvi = &cfg->dvi.actions[line];
+        scanline_action_t *hdmi = &cfg->hdmi.actions[line];
+        uint32_t frame = line == vsync_start ? SCANLINE_FRAME : 0;
+
+        if (line >= active_start) {
+            set_action(dvi, cfg->vactive_line_dvi, count_of(cfg->vactive_line_dvi), SCANLINE_ACTIVE);
+            set_action(hdmi, cfg->vactive_di_null, cfg->vactive_di_null_len,
+                       SCANLINE_TICK | SCANLINE_AUDIO | SCANLINE_ACTIVE);
+        } else if (line >= vsync_start && line < back_porch_start) {
+            set_action(dvi, cfg->vblank_line_vsync_on, count_of(cfg->vblank_line_vsync_on), frame);
+            if (frame)
+                set_action(hdmi, cfg->vblank_acr_vsync_on, cfg->vblank_acr_vsync_on_len, SCANLINE_TICK | frame);
+            else
+                set_action(hdmi, cfg->vblank_infoframe_vsync_on, cfg->vblank_infoframe_vsync_on_len, SCANLINE_TICK);
+        } else {
+            set_action(dvi, cfg->vblank_line_vsync_off, count_of(cfg->vblank_line_vsync_off), 0);
+            if (line >= back_porch_start && line % 4 == 0)
+                set_action(hdmi, cfg->vblank_acr_vsync_off, cfg->vblank_acr_vsync_off_len, SCANLINE_TICK);
+            else if (line == 0)
+                set_action(hdmi, cfg->vblank_avi_infoframe, cfg->vblank_avi_infoframe_len, SCANLINE_TICK);
+            else
+                set_action(hdmi, cfg->vblank_di_null, cfg->vblank_di_null_len, SCANLINE_TICK | SCANLINE_AUDIO);
         }
     }
 
-    if (dvi_mode) {
-        // Pure DVI: simple active line without Data Islands
-        ch->read_addr = (uintptr_t)vactive_line_dvi;
-        ch->transfer_count = count_of(vactive_line_dvi);
-    } else {
-        uint32_t *buf = dma_pong ? vactive_di_ping : vactive_di_pong;
-        const uint32_t *di_words = hstx_di_queue_get_audio_packet();
-        if (di_words) {
-            vactive_di_len = build_line_with_di(buf, di_words, false, true);
-            ch->read_addr = (uintptr_t)buf;
-            ch->transfer_count = vactive_di_len;
-        } else {
-            ch->read_addr = (uintptr_t)vactive_di_null;
-            ch->transfer_count = vactive_di_null_len;
+#if VIDEO_OUTPUT_VBLANK_CHAIN
+    build_runs(cfg, &cfg->hdmi);
+    build_runs(cfg, &cfg->dvi);
+#endif
+#if VIDEO_OUTPUT_DI_ZERO_COPY
+    for (uint32_t ch = 0; ch < 2; ch++) {
+        for (uint32_t kind = 0; kind < LINE_KINDS; kind++) {
+            const uint32_t *line = kind != LINE_BLANK ? cfg->vactive_di_null : cfg->vblank_di_null;
+            uint32_t len = kind != LINE_BLANK ? cfg->vactive_di_null_len : cfg->vblank_di_null_len;
+            // A span line's active video starts with its own command
+            if (kind == LINE_SPANS)
+                len--;
+            dma_cb_t *cbs = cfg->di_cbs[ch][kind];
+            cbs[0].write_addr = (uintptr_t)&hstx_fifo_hw->fifo;
+            cbs[0].transfer_count = W_DATA_ISLAND;
+            cbs[0].ctrl = dma_ctrl_run[ch];
+            cbs[1].read_addr = (uintptr_t)&line[cfg->di_line_island_offset + W_DATA_ISLAND];
+            cbs[1].write_addr = (uintptr_t)&hstx_fifo_hw->fifo;
+            cbs[1].transfer_count = len - cfg->di_line_island_offset - W_DATA_ISLAND;
+            cbs[1].ctrl = dma_ctrl_line[ch];
         }
     }
+#endif
 }
 
-static inline void __scratch_x("")
-    video_output_handle_blanking(dma_channel_hw_t *ch, uint32_t v_scanline, bool send_acr, bool dma_pong)
+// Resolve a mode into everything the ISR plays: command lists, island lines and
+// scanline tables. Touches nothing the ISR reads unless cfg is the live configuration.
+static void build_config(video_config_t *cfg, const video_mode_t *mode)
 {
-    if (dvi_mode) {
-        // Pure DVI: simple blanking line without Data Islands
-        (void)send_acr;
-        (void)dma_pong;
-        (void)v_scanline;
-        ch->read_addr = (uintptr_t)vblank_line_vsync_off;
-        ch->transfer_count = count_of(vblank_line_vsync_off);
-    } else {
-        if (send_acr) {
-            ch->read_addr = (uintptr_t)vblank_acr_vsync_off;
-            ch->transfer_count = vblank_acr_vsync_off_len;
-        } else if (v_scanline == 0) {
-            ch->read_addr = (uintptr_t)vblank_avi_infoframe;
-            ch->transfer_count = vblank_avi_infoframe_len;
-        } else {
-            const uint32_t *di_words = hstx_di_queue_get_audio_packet();
-            if (di_words) {
-                uint32_t *buf = dma_pong ? vblank_di_ping : vblank_di_pong;
-                vblank_di_len = build_line_with_di(buf, di_words, false, false);
-                ch->read_addr = (uintptr_t)buf;
-                ch->transfer_count = vblank_di_len;
+    cfg->mode = mode;
+    cfg->v_total_lines = video_mode_v_total(mode);
+    cfg->v_active_start = cfg->v_total_lines - mode->v_active_lines;
+    cfg->di_in_hsync = mode->h_sync_width > W_PREAMBLE + W_DATA_ISLAND;
+    // Front porch (and sync) runs, then the RAW command
+    cfg->di_line_island_offset = (cfg->di_in_hsync ? 2 * 3 : 3 * 3) + 1;
+
+    build_dvi_line(cfg, cfg->vblank_line_vsync_off, false, false);
+    build_dvi_line(cfg, cfg->vblank_line_vsync_on, true, false);
+    build_dvi_line(cfg, cfg->vactive_line_dvi, false, true);
+
+    // Initialize HDMI Data Island packets (needed if user switches to HDMI mode)
+    hstx_packet_t packet;
+    hstx_data_island_t island;
+
+    // hstx_encode_data_island() takes pulse states for active-low sync
+    const bool di_hsync = cfg->di_in_hsync != mode->h_sync_positive;
+    const bool di_vsync_on = !mode->v_sync_positive;
+    const bool di_vsync_off = mode->v_sync_positive;
+
+    // 48 kHz with N = 6144 makes CTS the TMDS clock in kHz
+    hstx_packet_set_acr(&packet, 6144, mode->pixel_clock_khz);
+    hstx_encode_data_island(&island, &packet, di_vsync_on, di_hsync);
+    cfg->vblank_acr_vsync_on_len = build_line_with_di(cfg, cfg->vblank_acr_vsync_on, island.words, true, false);
+    hstx_encode_data_island(&island, &packet, di_vsync_off, di_hsync);
+    cfg->vblank_acr_vsync_off_len = build_line_with_di(cfg, cfg->vblank_acr_vsync_off, island.words, false, false);
+
+    hstx_packet_set_audio_infoframe(&packet, 48000, 2, 16);
+    hstx_encode_data_island(&island, &packet, di_vsync_on, di_hsync);
+    cfg->vblank_infoframe_vsync_on_len =
+        build_line_with_di(cfg, cfg->vblank_infoframe_vsync_on, island.words, true, false);
+    hstx_encode_data_island(&island, &packet, di_vsync_off, di_hsync);
+    cfg->vblank_infoframe_vsync_off_len =
+        build_line_with_di(cfg, cfg->vblank_infoframe_vsync_off, island.words, false, false);
+
+    hstx_packet_set_avi_infoframe(&packet, mode->vic);
+    hstx_encode_data_island(&island, &packet, di_vsync_off, di_hsync);
+    cfg->vblank_avi_infoframe_len = build_line_with_di(cfg, cfg->vblank_avi_infoframe, island.words, false, false);
+
+    const uint32_t *null_island = hstx_get_null_data_island(di_vsync_off, di_hsync);
+    cfg->vblank_di_null_len = build_line_with_di(cfg, cfg->vblank_di_null, null_island, false, false);
+    cfg->vactive_di_null_len = build_line_with_di(cfg, cfg->vactive_di_null, null_island, false, true);
+
+    // Audio islands from the queue go where the null islands are
+    cfg->samples_per_line = hstx_di_queue_samples_per_line(mode->pixel_clock_khz, video_mode_h_total(mode));
+    cfg->di_vsync = di_vsync_off;
+    cfg->di_hsync = di_hsync;
+
+    for (uint32_t f = 0; f < VIDEO_PIXEL_FORMAT_COUNT; f++)
+        build_layout(mode, (video_pixel_format_t)f, &cfg->layouts[f]);
+    build_scanline_tables(cfg);
+}
+
+// ============================================================================
+// DMA IRQ Handler
+// ============================================================================
+
+// Scratch X holds the line-posting path, and shares its 4 KB with core 1's stack.
+// Building a line's pixel block runs after the reprogram, so it lives in SRAM.
+
+// Line 0: take a pending configuration and the DVI/HDMI selection. Nothing the old
+// configuration owns is still queued for the DMA except the line now playing.
+static inline video_config_t *__scratch_x("") start_frame(video_config_t *cfg)
+{
+    video_config_t *next = pending_config;
+    if (next) {
+        cfg = next;
+        config = next;
+        hstx_di_queue_set_timing(next->samples_per_line, next->di_vsync, next->di_hsync);
+    }
+    scanline_table = dvi_mode ? &cfg->dvi : &cfg->hdmi;
+    return cfg;
+}
+
+// Place the latched letterbox in the mode. Only what decides the first active
+// line's command block; the commands and border words follow in build_letterbox().
+static void __no_inline_not_in_flash_func(place_letterbox)(const video_config_t *cfg)
+{
+    const pixel_layout_t *l = &cfg->layouts[scan.format];
+    const uint32_t v_active = cfg->mode->v_active_lines;
+    uint32_t width = scan.letterbox_width & ~(32 / l->bpp - 1);
+    uint32_t rows = scan.letterbox_height;
+#if !DMA_CTRL_CHANNELS
+    // No control channels to send the content between borders
+    width = 0;
+#endif
+    if (!width || width > l->width)
+        width = l->width;
+    if (!rows || rows > v_active)
+        rows = v_active;
+
+    letterbox.top = (v_active - rows) / 2;
+    letterbox.rows = rows;
+    letterbox.width = width;
+    letterbox.sides = width < l->width;
+}
+
+// Border commands for the placed letterbox. Content rows with side borders get a
+// layout of the content width, so every source fills only that.
+static void __no_inline_not_in_flash_func(build_letterbox)(const video_config_t *cfg)
+{
+    const pixel_layout_t *l = layout;
+    const uint32_t out_shift = l->narrow; // Doubled: two output pixels per source pixel
+    const uint32_t colour = (scan.border_colour & (0xffffffffu >> (32 - l->bpp))) * l->span_replicate;
+    const uint32_t width = letterbox.width;
+
+    letterbox.border[0] = HSTX_CMD_TMDS_REPEAT | cfg->mode->h_active_pixels;
+    letterbox.border[1] = colour;
+    if (letterbox.sides) {
+        uint32_t left = (l->width - width) / 2;
+        letterbox.cmds[0] = HSTX_CMD_TMDS_REPEAT | (left << out_shift);
+        letterbox.cmds[1] = colour;
+        letterbox.cmds[2] = HSTX_CMD_TMDS | (width << out_shift);
+        letterbox.cmds[3] = HSTX_CMD_TMDS_REPEAT | ((l->width - width - left) << out_shift);
+        letterbox.cmds[4] = colour;
+        letterbox_layout = *l;
+        letterbox_layout.width = width;
+        letterbox_layout.line_words = width * l->bpp / 32;
+        letterbox_layout.pixel_transfers = l->narrow ? width : letterbox_layout.line_words;
+        layout = &letterbox_layout;
+    }
+}
+
+// The frame's framebuffer: one set since the last frame, then the newest present
+static void __no_inline_not_in_flash_func(start_present)(void)
+{
+    const uint32_t *released = front_buffer;
+    if (scan.framebuffer_serial != front_serial) {
+        front_serial = scan.framebuffer_serial;
+        front_buffer = scan.pixels;
+        present_taken = scan.present_count;
+    }
+    uint32_t count = present_count;
+    if (count != present_taken) {
+        front_buffer = present_next;
+        present_taken = count;
+    }
+    if (scan.pixels)
+        scan.pixels = front_buffer;
+    if (released && released != front_buffer && present_callback)
+        present_callback(released);
+}
+
+// Copy the published descriptor. Marking it first, and checking it is still the one
+// published, keeps a setter that publishes twice meanwhile from rewriting it.
+static inline void __scratch_x("") latch_scanout(void)
+{
+    const scanout_t *desc;
+    do {
+        desc = scanout;
+        scanout_latching = desc;
+        __dmb();
+    } while (desc != scanout);
+    scan = *desc;
+    __dmb();
+    scanout_latching = NULL;
+}
+
+// First active line: latch the scan-out descriptor for the frame. Done before the
+// line's command block is posted, since whether it ends in a TMDS command depends on it.
+static inline void __scratch_x("") latch_active(const video_config_t *cfg)
+{
+    latch_scanout();
+    place_letterbox(cfg);
+}
+
+// The rest of the frame's setup, once the first active line's block is posted
+static inline void __scratch_x("") start_active(const video_config_t *cfg)
+{
+    start_present();
+    scan_row = scan.pixels;
+    scan_repeat_left = scan.line_repeat;
+    // The last pixels of the previous frame left the expander a vblank ago,
+    // and this line's are the next it will see
+    layout = &cfg->layouts[scan.format];
+    hstx_ctrl_hw->expand_tmds = layout->expand_tmds;
+    hstx_ctrl_hw->expand_shift = layout->expand_shift;
+    build_letterbox(cfg);
+#if VIDEO_OUTPUT_LINE_CACHE_SIZE
+    // Lines are only repeated within a frame, and the layout may have changed
+    line_cache_stats = line_cache_frame;
+    line_cache_frame = (video_output_line_cache_stats_t){0};
+    for (uint32_t i = 0; i < VIDEO_OUTPUT_LINE_CACHE_SIZE; i++)
+        line_cache_drawn[i] = line_cache_sent[i] = UINT32_MAX;
+#endif
+#if VIDEO_OUTPUT_LINE_RING_SIZE
+    line_ring_frame++;
+    line_ring_active = scan.line_ring;
+#endif
+}
+
+// Whether this frame's active lines come from the callbacks, not a framebuffer or the ring
+static inline bool __scratch_x("") scan_from_callbacks(void)
+{
+#if VIDEO_OUTPUT_LINE_RING_SIZE
+    if (scan.line_ring)
+        return false;
+#endif
+    return !scan.pixels;
+}
+
+// A line's active video as HSTX commands: TMDS_REPEAT and one word per solid run,
+// TMDS and the pixels per raw segment. Lengths are rounded down to whole words, and
+// the line is cut or padded with black to the mode's width. Returns the length in words.
+static uint32_t __no_inline_not_in_flash_func(build_span_line)(uint32_t *dst, const video_span_t *s, uint32_t count)
+{
+    const pixel_layout_t *l = layout;
+    const uint32_t mask = 0xffffffffu >> (32 - l->bpp);
+    const uint32_t out_shift = l->narrow; // Doubled: two output pixels per source pixel
+    uint32_t *p = dst;
+    uint32_t left = l->width;
+
+    for (; count && left; count--, s++) {
+        uint32_t n = (s->length < left ? s->length : left) & ~(l->span_unit - 1);
+        if (!n)
+            continue;
+        left -= n;
+        if (!s->pixels) {
+            *p++ = HSTX_CMD_TMDS_REPEAT | (n << out_shift);
+            *p++ = (s->colour & mask) * l->span_replicate;
+        } else if (l->narrow) {
+            // One word per source pixel, filled with it as a narrow DMA write would be
+            *p++ = HSTX_CMD_TMDS | (n << out_shift);
+            if (l->bpp == 16) {
+                const uint16_t *src = s->pixels;
+                for (uint32_t i = 0; i < n; i++)
+                    *p++ = src[i] * l->span_replicate;
             } else {
-                ch->read_addr = (uintptr_t)vblank_di_null;
-                ch->transfer_count = vblank_di_null_len;
+                const uint8_t *src = s->pixels;
+                for (uint32_t i = 0; i < n; i++)
+                    *p++ = src[i] * l->span_replicate;
             }
+        } else {
+            *p++ = HSTX_CMD_TMDS | n;
+            const uint32_t *src = s->pixels;
+            for (uint32_t i = 0; i < n / l->span_unit; i++)
+                *p++ = src[i];
         }
     }
+    if (left) {
+        *p++ = HSTX_CMD_TMDS_REPEAT | (left << out_shift);
+        *p++ = 0;
+    }
+    return (uint32_t)(p - dst);
 }
 
-static inline void __scratch_x("") video_output_handle_active_data(dma_channel_hw_t *ch)
+// The next line buffer, filled with black
+static uint32_t *__scratch_x("") black_line(void)
 {
-    ch->read_addr = (uintptr_t)line_buffer;
-    ch->transfer_count = (MODE_H_ACTIVE_PIXELS * sizeof(uint16_t)) / sizeof(uint32_t);
+    line_buffer_idx ^= 1;
+    uint32_t *dst32 = line_buffer[line_buffer_idx];
+    for (uint32_t i = 0; i < layout->line_words; i++) {
+        dst32[i] = 0;
+    }
+    return dst32;
 }
 
-// ============================================================================
-// DMA IRQ Handler
-// ============================================================================
+#if DMA_CTRL_CHANNELS
+static inline dma_cb_t *put_segment(dma_cb_t *cb, const void *src, uint32_t transfers, uint32_t ctrl)
+{
+    cb->read_addr = (uintptr_t)src;
+    cb->write_addr = (uintptr_t)&hstx_fifo_hw->fifo;
+    cb->transfer_count = transfers;
+    cb->ctrl = ctrl;
+    return cb + 1;
+}
+
+// Start the next pixel block's segments for pixel_ch, behind the left border if
+// there is one. A span line brings its own TMDS commands.
+static dma_cb_t *__no_inline_not_in_flash_func(segments_begin)(uint32_t pixel_ch, bool spans)
+{
+    segment_set ^= 1;
+    dma_cb_t *cb = segment_cbs[segment_set];
+    if (letterbox.sides)
+        cb = put_segment(cb, letterbox.cmds, spans ? 2 : 3, dma_ctrl_run[pixel_ch]);
+    return cb;
+}
+
+// Close the segments with the right border, or make the last one end the line, and
+// point the pixel block at them
+static void __no_inline_not_in_flash_func(segments_end)(dma_cb_t *cb, uint32_t pixel_ch)
+{
+    const dma_cb_t *cbs = segment_cbs[segment_set];
+    if (letterbox.sides) {
+        cb = put_segment(cb, &letterbox.cmds[3], 2, dma_ctrl_line[pixel_ch]);
+        active_narrow = false;
+    } else {
+        cb[-1].ctrl = layout->dma_ctrl[pixel_ch];
+    }
+    active_pixels = (const uint32_t *)cbs[0].read_addr;
+    active_transfers = cbs[0].transfer_count;
+    active_cbs = cb - cbs > 1 ? &cbs[1] : NULL;
+}
+#endif
+
+// Point the next pixel block at the windows, a DMA segment each, for pixel_ch.
+// Widths are rounded down to whole words, and the line is cut or padded with black
+// to the content width.
+static void __no_inline_not_in_flash_func(compose_windows)(const video_window_t *w, uint32_t count, uint32_t pixel_ch)
+{
+    const pixel_layout_t *l = layout;
+    uint32_t left = l->width;
+#if DMA_CTRL_CHANNELS
+    dma_cb_t *cb = segments_begin(pixel_ch, false);
+    for (; count && left; count--, w++) {
+        uint32_t n = (w->width < left ? w->width : left) & ~(l->span_unit - 1);
+        if (!n)
+            continue;
+        left -= n;
+        cb = put_segment(cb, w->pixels, n / l->span_unit, l->dma_ctrl_run[pixel_ch]);
+    }
+    if (left)
+        cb = put_segment(cb, black_line(), left / l->span_unit, l->dma_ctrl_run[pixel_ch]);
+    segments_end(cb, pixel_ch);
+#else
+    (void)pixel_ch;
+    line_buffer_idx ^= 1;
+    uint8_t *dst = (uint8_t *)line_buffer[line_buffer_idx];
+    for (; count && left; count--, w++) {
+        uint32_t n = (w->width < left ? w->width : left) & ~(l->span_unit - 1);
+        memcpy(dst, w->pixels, n * l->bpp / 8);
+        dst += n * l->bpp / 8;
+        left -= n;
+    }
+    memset(dst, 0, left * l->bpp / 8);
+    active_pixels = line_buffer[line_buffer_idx];
+#endif
+}
+
+#if VIDEO_OUTPUT_LINE_CACHE_SIZE
+// The cached scanline callback's line: drawn into the least recently sent buffer
+// the DMA is not reading, or an earlier line's buffer. NULL if that is gone.
+static const uint32_t *__no_inline_not_in_flash_func(line_cache_take)(uint32_t v_scanline, uint32_t active_line)
+{
+    uint32_t slot = line_cache_last == 0 ? 1 : 0;
+    for (uint32_t i = 0; i < VIDEO_OUTPUT_LINE_CACHE_SIZE; i++) {
+        // Unused buffers (UINT32_MAX) wrap to the front
+        if (i != line_cache_last && line_cache_sent[i] + 1 < line_cache_sent[slot] + 1)
+            slot = i;
+    }
+
+    uint32_t line = cached_scanline_callback(v_scanline, active_line, line_cache[slot]);
+    if (line == active_line) {
+        line_cache_drawn[slot] = active_line;
+        line_cache_frame.drawn++;
+    } else {
+        for (slot = 0; slot < VIDEO_OUTPUT_LINE_CACHE_SIZE; slot++) {
+            if (line_cache_drawn[slot] == line || line_cache_sent[slot] == line)
+                break;
+        }
+        if (slot == VIDEO_OUTPUT_LINE_CACHE_SIZE) {
+            line_cache_frame.missed++;
+            return NULL;
+        }
+        line_cache_frame.reused++;
+    }
+    line_cache_sent[slot] = active_line;
+    line_cache_last = slot;
+    return line_cache[slot];
+}
+#endif
+
+#if VIDEO_OUTPUT_LINE_RING_SIZE
+// The buffer rendered for the line at pos, or NULL if it is not ready. Buffers for
+// lines already passed arrived too late and are dropped.
+static const uint32_t *__scratch_x("") line_ring_take(uint32_t pos)
+{
+    const uint32_t *pixels = NULL;
+    uint32_t tail = line_ring_tail;
+    while (!pixels && tail != line_ring_head) {
+        int32_t ahead = (int32_t)(line_ring_pos[tail] - pos);
+        if (ahead > 0)
+            break;
+        if (ahead == 0)
+            pixels = (const uint32_t *)line_ring_buffer[tail];
+        tail = (tail + 1) % VIDEO_OUTPUT_LINE_RING_SIZE;
+    }
+    line_ring_tail = tail;
+
+    // The other channel is still sending the previous line, so the last two slots
+    // taken stay out of the producer's reach
+    uint32_t free = line_ring_free;
+    while ((tail + VIDEO_OUTPUT_LINE_RING_SIZE - free) % VIDEO_OUTPUT_LINE_RING_SIZE > 2)
+        free = (free + 1) % VIDEO_OUTPUT_LINE_RING_SIZE;
+    line_ring_free = free;
+
+    if (!pixels)
+        line_ring_late++;
+    return pixels;
+}
+#endif
 
 void __scratch_x("") dma_irq_handler()
 {
@@ -352,68 +1025,270 @@ void __scratch_x("") dma_irq_handler()
     dma_channel_hw_t *ch = &dma_hw->ch[ch_num];
     dma_hw->intr = 1U << ch_num;
     dma_pong = !dma_pong;
+    video_config_t *cfg = config;
 
-    // Advance audio/data-island scheduler exactly once per scanline (HDMI mode only)
-    if (!dvi_mode && !vactive_cmdlist_posted) {
-        hstx_di_queue_tick();
+#if VIDEO_OUTPUT_DI_ZERO_COPY
+    if (di_held[ch_num]) {
+        // The channel has finished its line, so it is done reading the island
+        hstx_di_queue_release_audio_packet();
+        di_held[ch_num] = false;
+    }
+#endif
+
+    if (vactive_cmdlist_posted) {
+        // Second block of an active line: the pixels rendered by the previous IRQ
+        ch->read_addr = (uintptr_t)active_pixels;
+        ch->transfer_count = active_transfers;
+        if (active_narrow) {
+            ch->al1_ctrl = layout->dma_ctrl[ch_num];
+            ctrl_narrow[ch_num] = true;
+        } else if (ctrl_narrow[ch_num]) {
+            // A border row after doubled content: its commands need word reads
+            ch->al1_ctrl = dma_ctrl_line[ch_num];
+            ctrl_narrow[ch_num] = false;
+        }
+#if DMA_CTRL_CHANNELS
+        if (active_cbs) {
+            // Segmented: the control blocks follow with the rest
+            dma_hw->ch[DMACH_PING_CTRL + ch_num].read_addr = (uintptr_t)active_cbs;
+            ch->al1_ctrl = active_cbs[-1].ctrl;
+        }
+#endif
+        VIDEO_OUTPUT_DMA_REPROGRAMMED();
+        vactive_cmdlist_posted = false;
+        v_scanline = (v_scanline + 1) % cfg->v_total_lines;
+        return;
+    }
+
+    if (v_scanline == 0)
+        cfg = start_frame(cfg);
+
+    const scanline_table_t *table = scanline_table;
+    const scanline_action_t *action = &table->actions[v_scanline];
+    uint32_t flags = action->flags;
+    const uint32_t *cmd = action->cmd;
+    uint32_t len = action->len;
+
+    uint32_t kind = LINE_BLANK;
+    bool border = false;
+    video_output_window_cb_t window_cb = NULL;
+    video_output_span_cb_t span_cb = NULL;
+    if (flags & SCANLINE_ACTIVE) {
+        if (v_scanline == cfg->v_active_start)
+            latch_active(cfg);
+        border = v_scanline - cfg->v_active_start - letterbox.top >= letterbox.rows;
+        if (!border && scan_from_callbacks()) {
+            window_cb = window_callback;
+            span_cb = window_cb ? NULL : span_callback;
+        }
+        kind = border || letterbox.sides || span_cb ? LINE_SPANS : LINE_ACTIVE;
+        len -= kind == LINE_SPANS;
     }
 
-    scanline_state_t state;
-    get_scanline_state(v_scanline, &state);
+#if DMA_CTRL_CHANNELS
+    const dma_cb_t *cbs = NULL;
+#endif
 
-    if (state.vsync_active) {
-        video_output_handle_vsync(ch, v_scanline);
-    } else if (state.active_video && !vactive_cmdlist_posted) {
-        video_output_handle_active_start(ch, v_scanline, state.active_line, dma_pong);
+    if (flags & SCANLINE_TICK)
+        hstx_di_queue_tick();
+    if (flags & SCANLINE_AUDIO) {
+        const uint32_t *di_words = hstx_di_queue_take_audio_packet();
+        if (di_words) {
+#if VIDEO_OUTPUT_DI_ZERO_COPY
+            // Send only the prefix of the null-island line; the control blocks follow
+            // it with the island from the queue slot and the rest of the line
+            dma_cb_t *island_cbs = cfg->di_cbs[ch_num][kind];
+            island_cbs[0].read_addr = (uintptr_t)di_words;
+            __compiler_memory_barrier();
+            len = cfg->di_line_island_offset;
+            cbs = island_cbs;
+            di_held[ch_num] = true;
+#else
+            len = build_line_with_di(cfg, di_line_buf[ch_num], di_words, false, kind != LINE_BLANK);
+            len -= kind == LINE_SPANS;
+            cmd = di_line_buf[ch_num];
+            hstx_di_queue_release_audio_packet();
+#endif
+        }
+    }
+#if VIDEO_OUTPUT_VBLANK_CHAIN
+    if (action->run)
+        cbs = &table->run_cbs[ch_num][v_scanline + 1];
+#endif
+    ch->read_addr = (uintptr_t)cmd;
+    ch->transfer_count = len;
+    if (ctrl_narrow[ch_num]) {
+        ch->al1_ctrl = dma_ctrl_line[ch_num];
+        ctrl_narrow[ch_num] = false;
+    }
+#if DMA_CTRL_CHANNELS
+    if (cbs) {
+        // After this block the channel reloads itself from the control blocks, raising
+        // no IRQ until the last one hands back to the other channel
+        dma_hw->ch[DMACH_PING_CTRL + ch_num].read_addr = (uintptr_t)cbs;
+        ch->al1_ctrl = dma_ctrl_run[ch_num];
+    }
+#endif
+    VIDEO_OUTPUT_DMA_REPROGRAMMED();
+
+    // The channel just reprogrammed only starts once the other one has sent the
+    // current line, so everything below is off the DMA's critical path
+    if (flags & SCANLINE_ACTIVE) {
+        if (v_scanline == cfg->v_active_start)
+            start_active(cfg);
+        uint32_t active_line = v_scanline - cfg->v_active_start - letterbox.top;
+        active_transfers = layout->pixel_transfers;
+        active_narrow = layout->narrow;
+#if DMA_CTRL_CHANNELS
+        active_cbs = NULL;
+#endif
+        if (border) {
+            // Above or below the content: one run of the border colour
+            active_pixels = letterbox.border;
+            active_transfers = count_of(letterbox.border);
+            active_narrow = false;
+            vactive_cmdlist_posted = true;
+            return;
+        }
+#if VIDEO_OUTPUT_LINE_RING_SIZE
+        // Kept up to date without the ring too, so a producer can start ahead of it
+        uint32_t ring_pos = RING_POS(line_ring_frame, active_line);
+        line_ring_beam = ring_pos;
+#endif
+        if (scan.pixels) {
+            // Scan-out: the pixel block reads the framebuffer row in place
+            if (scan_repeat_left == 0) {
+                scan_row += scan.stride_words;
+                scan_repeat_left = scan.line_repeat;
+            }
+            scan_repeat_left--;
+            active_pixels = scan_row;
+#if VIDEO_OUTPUT_LINE_RING_SIZE
+        } else if (scan.line_ring) {
+            // Rendered ahead: a line that is not ready goes out black
+            active_pixels = line_ring_take(ring_pos);
+            if (!active_pixels)
+                active_pixels = black_line();
+#endif
+        } else if (window_cb) {
+            // The pixel block goes out on the other channel
+            uint32_t count = window_cb(v_scanline, active_line, windows);
+            compose_windows(windows, count > VIDEO_OUTPUT_MAX_WINDOWS ? 0 : count, ch_num ^ 1);
+        } else if (span_cb) {
+            uint32_t count = span_cb(v_scanline, active_line, spans);
+            line_buffer_idx ^= 1;
+            uint32_t *dst32 = line_buffer[line_buffer_idx];
+            active_transfers = build_span_line(dst32, spans, count > VIDEO_OUTPUT_MAX_SPANS ? 0 : count);
+            active_narrow = false;
+            active_pixels = dst32;
+#if VIDEO_OUTPUT_LINE_CACHE_SIZE
+        } else if (cached_scanline_callback) {
+            active_pixels = line_cache_take(v_scanline, active_line);
+            if (!active_pixels)
+                active_pixels = black_line();
+#endif
+        } else if (scanline_callback) {
+            line_buffer_idx ^= 1;
+            uint32_t *dst32 = line_buffer[line_buffer_idx];
+            scanline_callback(v_scanline, active_line, dst32);
+            active_pixels = dst32;
+        } else {
+            // If no callback, just output black pixels
+            active_pixels = black_line();
+        }
+#if DMA_CTRL_CHANNELS
+        if (letterbox.sides && !window_cb) {
+            // The content between its borders
+            dma_cb_t *cb = segments_begin(ch_num ^ 1, span_cb != NULL);
+            cb = put_segment(cb, active_pixels, active_transfers,
+                             active_narrow ? layout->dma_ctrl_run[ch_num ^ 1] : dma_ctrl_run[ch_num ^ 1]);
+            segments_end(cb, ch_num ^ 1);
+        }
+#endif
         vactive_cmdlist_posted = true;
-    } else if (state.active_video && vactive_cmdlist_posted) {
-        video_output_handle_active_data(ch);
-        vactive_cmdlist_posted = false;
-    } else {
-        video_output_handle_blanking(ch, v_scanline, state.send_acr, dma_pong);
+        return;
     }
-    if (!vactive_cmdlist_posted)
-        v_scanline = (v_scanline + 1) % MODE_V_TOTAL_LINES;
+    if (flags & SCANLINE_FRAME) {
+        // A switch taken at line 0 is complete: the old configuration is free
+        if (pending_config == cfg)
+            pending_config = NULL;
+        video_frame_count++;
+        if (vsync_callback)
+            vsync_callback();
+    }
+    if (flags & SCANLINE_TICK) {
+        for (uint32_t i = 0; i < action->run; i++)
+            hstx_di_queue_tick();
+    }
+    v_scanline = (v_scanline + 1 + action->run) % cfg->v_total_lines;
 }
 
 // ============================================================================
 // Public Interface
 // ============================================================================
 
+bool video_output_set_mode(const video_mode_t *new_mode)
+{
+    if (!mode_fits(new_mode) || !format_fits(new_mode, scanout->format))
+        return false;
+    // Both configurations are in use until the ISR has taken the pending one
+    if (output_running && pending_config)
+        return false;
+    selected_mode = new_mode;
+    if (!output_running) {
+        // Not playing yet: rebuild in place if video_output_init() has already run
+        if (config->mode) {
+            build_config(config, new_mode);
+            hstx_di_queue_set_timing(config->samples_per_line, config->di_vsync, config->di_hsync);
+        }
+        return true;
+    }
+
+    // Build the spare configuration while the ISR plays the live one, then hand it over
+    video_config_t *spare = config == &configs[0] ? &configs[1] : &configs[0];
+    build_config(spare, new_mode);
+    __dmb();
+    pending_config = spare;
+    return true;
+}
+
+const video_mode_t *video_output_get_mode(void)
+{
+    const video_mode_t *mode = config->mode;
+    return mode ? mode : selected_mode;
+}
+
+bool video_output_switch_pending(void)
+{
+    const video_config_t *cfg = config;
+    return pending_config || scanline_table != (dvi_mode ? &cfg->dvi : &cfg->hdmi);
+}
+
 void video_output_init(uint16_t width, uint16_t height)
 {
     frame_width = width;
     frame_height = height;
 
-    // Claim DMA channels for HSTX (channels 0 and 1)
+    // Claim DMA channels for HSTX (channels 0 and 1, plus their control channels 2 and 3)
     dma_channel_claim(DMACH_PING);
     dma_channel_claim(DMACH_PONG);
+#if DMA_CTRL_CHANNELS
+    dma_channel_claim(DMACH_PING_CTRL);
+    dma_channel_claim(DMACH_PONG_CTRL);
+#endif
+
+    for (uint32_t ch = 0; ch < 2; ch++) {
+        dma_channel_config c = line_dma_config(ch, ch ^ 1);
+        dma_ctrl_line[ch] = channel_config_get_ctrl_value(&c);
+#if DMA_CTRL_CHANNELS
+        channel_config_set_chain_to(&c, DMACH_PING_CTRL + ch);
+        channel_config_set_irq_quiet(&c, true);
+        dma_ctrl_run[ch] = channel_config_get_ctrl_value(&c);
+#endif
+    }
 
-    // Initialize HDMI Data Island packets (needed if user switches to HDMI mode)
-    hstx_packet_t packet;
-    hstx_data_island_t island;
-
-    hstx_packet_set_acr(&packet, 6144, 25200);
-    hstx_encode_data_island(&island, &packet, true, true);
-    vblank_acr_vsync_on_len = build_line_with_di(vblank_acr_vsync_on, island.words, true, false);
-    hstx_encode_data_island(&island, &packet, false, true);
-    vblank_acr_vsync_off_len = build_line_with_di(vblank_acr_vsync_off, island.words, false, false);
-
-    hstx_packet_set_audio_infoframe(&packet, 48000, 2, 16);
-    hstx_encode_data_island(&island, &packet, true, true);
-    vblank_infoframe_vsync_on_len = build_line_with_di(vblank_infoframe_vsync_on, island.words, true, false);
-    hstx_encode_data_island(&island, &packet, false, true);
-    vblank_infoframe_vsync_off_len = build_line_with_di(vblank_infoframe_vsync_off, island.words, false, false);
-
-    hstx_packet_set_avi_infoframe(&packet, 1);
-    hstx_encode_data_island(&island, &packet, false, true);
-    vblank_avi_infoframe_len = build_line_with_di(vblank_avi_infoframe, island.words, false, false);
-
-    vblank_di_null_len = build_line_with_di(vblank_di_null, hstx_get_null_data_island(false, true), false, false);
-    vactive_di_null_len = build_line_with_di(vactive_di_null, hstx_get_null_data_island(false, true), false, true);
-
-    vblank_di_len = build_line_with_di(vblank_di_ping, hstx_get_null_data_island(false, true), false, false);
-    memcpy(vblank_di_pong, vblank_di_ping, sizeof(vblank_di_ping));
+    build_config(config, selected_mode);
+    hstx_di_queue_set_timing(config->samples_per_line, config->di_vsync, config->di_hsync);
 }
 
 void video_output_set_background_task(video_output_task_fn task)
@@ -428,6 +1303,7 @@ bool video_output_get_dvi_mode(void)
 
 void video_output_set_dvi_mode(bool enabled)
 {
+    // The ISR switches tables at the next line 0
     dvi_mode = enabled;
 }
 
@@ -436,21 +1312,186 @@ void video_output_set_scanline_callback(video_output_scanline_cb_t cb)
     scanline_callback = cb;
 }
 
+#if VIDEO_OUTPUT_LINE_CACHE_SIZE
+void video_output_set_cached_scanline_callback(video_output_cached_scanline_cb_t cb)
+{
+    cached_scanline_callback = cb;
+}
+
+video_output_line_cache_stats_t video_output_line_cache_get_stats(void)
+{
+    return line_cache_stats;
+}
+#endif
+
+void video_output_set_span_callback(video_output_span_cb_t cb)
+{
+    span_callback = cb;
+}
+
+void video_output_set_window_callback(video_output_window_cb_t cb)
+{
+    window_callback = cb;
+}
+
 void video_output_set_vsync_callback(video_output_vsync_cb_t cb)
 {
     vsync_callback = cb;
 }
 
-void video_output_core1_run(void)
+// Fill the descriptor that is not published, then publish it. The ISR may still be
+// copying that one if it latched it before the last publish; the copy is short.
+static void publish_scanout(const scanout_t *desc)
 {
-    // HSTX Hardware Setup
-    hstx_ctrl_hw->expand_tmds = 4 << HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB | 8 << HSTX_CTRL_EXPAND_TMDS_L2_ROT_LSB |
-                                5 << HSTX_CTRL_EXPAND_TMDS_L1_NBITS_LSB | 3 << HSTX_CTRL_EXPAND_TMDS_L1_ROT_LSB |
-                                4 << HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB | 13 << HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB;
+    scanout_t *next = scanout == &scanouts[0] ? &scanouts[1] : &scanouts[0];
+    while (scanout_latching == next)
+        tight_loop_contents();
+    *next = *desc;
+    __dmb();
+    scanout = next;
+    // Ordered before the next publish reads scanout_latching
+    __dmb();
+}
 
-    hstx_ctrl_hw->expand_shift =
-        2 << HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB | 16 << HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB |
-        1 << HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_LSB | 0 << HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_LSB;
+bool video_output_set_framebuffer(const void *pixels, uint32_t stride_bytes, uint32_t line_repeat)
+{
+    if (pixels && ((((uintptr_t)pixels | stride_bytes) & 3) || line_repeat == 0))
+        return false;
+
+    scanout_t desc = *scanout;
+    desc.pixels = (const uint32_t *)pixels;
+    desc.stride_words = stride_bytes / sizeof(uint32_t);
+    desc.line_repeat = line_repeat;
+    desc.framebuffer_serial++;
+    desc.present_count = present_count;
+    publish_scanout(&desc);
+    return true;
+}
+
+bool video_output_present(const void *pixels)
+{
+    if (!pixels || ((uintptr_t)pixels & 3))
+        return false;
+
+    present_next = (const uint32_t *)pixels;
+    // The ISR must see the buffer before the count that makes it take it
+    __dmb();
+    present_count = present_count + 1;
+    return true;
+}
+
+const void *video_output_get_front_buffer(void)
+{
+    return front_buffer;
+}
+
+const void *video_output_get_pending_buffer(void)
+{
+    return present_count != present_taken ? present_next : NULL;
+}
+
+void video_output_wait_present(void)
+{
+    while (output_running && present_count != present_taken)
+        tight_loop_contents();
+}
+
+void video_output_set_present_callback(video_output_present_cb_t cb)
+{
+    present_callback = cb;
+}
+
+bool video_output_set_pixel_format(video_pixel_format_t format)
+{
+    if ((uint32_t)format >= VIDEO_PIXEL_FORMAT_COUNT || !format_fits(selected_mode, format))
+        return false;
+
+    scanout_t desc = *scanout;
+    desc.format = format;
+    publish_scanout(&desc);
+    return true;
+}
+
+video_pixel_format_t video_output_get_pixel_format(void)
+{
+    return scanout->format;
+}
+
+bool video_output_set_letterbox(uint32_t width, uint32_t height, uint32_t colour)
+{
+    const uint32_t bpp = video_pixel_format_bpp(scanout->format);
+    if (width > video_mode_source_width(selected_mode) || height > selected_mode->v_active_lines ||
+        (width * bpp) % 32)
+        return false;
+
+    scanout_t desc = *scanout;
+    desc.letterbox_width = width;
+    desc.letterbox_height = height;
+    desc.border_colour = colour;
+    publish_scanout(&desc);
+    return true;
+}
+
+#if VIDEO_OUTPUT_LINE_RING_SIZE
+
+void video_output_set_line_ring(bool enabled)
+{
+    scanout_t desc = *scanout;
+    desc.line_ring = enabled;
+    publish_scanout(&desc);
+}
+
+// The line after pos in the selected mode, or among the letterbox's content rows
+static uint32_t line_ring_step(uint32_t pos)
+{
+    uint32_t lines = scanout->letterbox_height;
+    if (!lines || lines > selected_mode->v_active_lines)
+        lines = selected_mode->v_active_lines;
+    if ((pos & 0xffffu) + 1 < lines)
+        return pos + 1;
+    return RING_POS((pos >> 16) + 1, 0);
+}
+
+uint32_t *video_output_line_ring_acquire(uint32_t *active_line)
+{
+    uint32_t head = line_ring_head;
+    if (!scanout->line_ring || (head + 1) % VIDEO_OUTPUT_LINE_RING_SIZE == line_ring_free)
+        return NULL;
+
+    // Never render a line the beam has reached. Until the ISR has latched the ring,
+    // start at the next frame, the first that can use it.
+    uint32_t beam = line_ring_beam;
+    uint32_t first = line_ring_active ? line_ring_step(beam) : RING_POS((beam >> 16) + 1, 0);
+    if ((int32_t)(line_ring_next - first) < 0)
+        line_ring_next = first;
+
+    line_ring_pos[head] = line_ring_next;
+    *active_line = line_ring_next & 0xffffu;
+    return (uint32_t *)line_ring_buffer[head];
+}
+
+void video_output_line_ring_commit(void)
+{
+    uint32_t head = line_ring_head;
+    line_ring_next = line_ring_step(line_ring_pos[head]);
+    // The pixels must be written before the ISR can see the new head
+    __dmb();
+    line_ring_head = (head + 1) % VIDEO_OUTPUT_LINE_RING_SIZE;
+}
+
+uint32_t video_output_line_ring_get_late(void)
+{
+    return line_ring_late;
+}
+
+#endif
+
+void video_output_core1_run(void)
+{
+    // HSTX Hardware Setup. The ISR sets the expander again at each frame's first active line.
+    layout = &config->layouts[scanout->format];
+    hstx_ctrl_hw->expand_tmds = layout->expand_tmds;
+    hstx_ctrl_hw->expand_shift = layout->expand_shift;
 
     hstx_ctrl_hw->csr = 0;
     hstx_ctrl_hw->csr = HSTX_CTRL_CSR_EXPAND_EN_BITS | 5U << HSTX_CTRL_CSR_CLKDIV_LSB |
@@ -470,18 +1511,26 @@ void video_output_core1_run(void)
     for (int i = PIN_HSTX_CLK; i <= PIN_HSTX_D2 + 1; ++i)
         gpio_set_function(i, 0);
 
-    // DMA Setup
-    dma_channel_config c = dma_channel_get_default_config(DMACH_PING);
-    channel_config_set_chain_to(&c, DMACH_PONG);
-    channel_config_set_dreq(&c, DREQ_HSTX);
-    dma_channel_configure(DMACH_PING, &c, &hstx_fifo_hw->fifo, vblank_line_vsync_off, count_of(vblank_line_vsync_off),
-                          false);
-
-    c = dma_channel_get_default_config(DMACH_PONG);
-    channel_config_set_chain_to(&c, DMACH_PING);
-    channel_config_set_dreq(&c, DREQ_HSTX);
-    dma_channel_configure(DMACH_PONG, &c, &hstx_fifo_hw->fifo, vblank_line_vsync_off, count_of(vblank_line_vsync_off),
-                          false);
+    // DMA Setup: lines 0 and 1 are preloaded without islands; the IRQ handler takes over at line 2
+    const scanline_action_t *first = config->dvi.actions;
+    dma_channel_config c = line_dma_config(DMACH_PING, DMACH_PONG);
+    dma_channel_configure(DMACH_PING, &c, &hstx_fifo_hw->fifo, first[0].cmd, first[0].len, false);
+
+    c = line_dma_config(DMACH_PONG, DMACH_PING);
+    dma_channel_configure(DMACH_PONG, &c, &hstx_fifo_hw->fifo, first[1].cmd, first[1].len, false);
+
+#if DMA_CTRL_CHANNELS
+    // Each copies one control block into its data channel per trigger, ending on CTRL_TRIG
+    for (uint ch = 0; ch < 2; ch++) {
+        c = dma_channel_get_default_config(DMACH_PING_CTRL + ch);
+        channel_config_set_read_increment(&c, true);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_ring(&c, true, __builtin_ctz(sizeof(dma_cb_t)));
+        channel_config_set_irq_quiet(&c, true);
+        dma_channel_configure(DMACH_PING_CTRL + ch, &c, &dma_hw->ch[ch], NULL, sizeof(dma_cb_t) / sizeof(uint32_t),
+                              false);
+    }
+#endif
 
     dma_hw->ints0 = (1U << DMACH_PING) | (1U << DMACH_PONG);
     dma_hw->inte0 = (1U << DMACH_PING) | (1U << DMACH_PONG);
@@ -490,9 +1539,15 @@ void video_output_core1_run(void)
     irq_set_enabled(DMA_IRQ_0, true);
 
     bus_ctrl_hw->priority = BUSCTRL_BUS_PRIORITY_DMA_W_BITS | BUSCTRL_BUS_PRIORITY_DMA_R_BITS;
+    scanline_table = dvi_mode ? &config->dvi : &config->hdmi;
+    output_running = true;
     dma_channel_start(DMACH_PING);
 
     while (1) {
+        if (!dvi_mode) {
+            hstx_audio_fifo_service();
+            hstx_di_queue_encode_ahead();
+        }
         if (background_task) {
             background_task();
         }
@@ -0,0 +1,104 @@
+#include "pico_hdmi/video_palette.h"
+
+#include "pico.h"
+
+// ============================================================================
+// Palette Tables
+// ============================================================================
+
+static void set_nibbles(video_palette_t *palette, uint32_t byte)
+{
+    palette->nibbles[byte] = (palette->pair[byte & 0xfu] & 0xffffu) | (palette->pair[byte >> 4] << 16);
+}
+
+void video_palette_set(video_palette_t *palette, const uint16_t *colours, uint32_t count)
+{
+    for (uint32_t i = 0; i < 256; i++)
+        palette->pair[i] = i < count ? colours[i] * 0x00010001u : 0;
+    for (uint32_t b = 0; b < 256; b++)
+        set_nibbles(palette, b);
+}
+
+void video_palette_set_colour(video_palette_t *palette, uint32_t index, uint16_t colour)
+{
+    palette->pair[index & 0xffu] = colour * 0x00010001u;
+    if (index >= 16)
+        return;
+    // Every byte with this index in either nibble
+    for (uint32_t n = 0; n < 16; n++) {
+        set_nibbles(palette, (n << 4) | index);
+        set_nibbles(palette, (index << 4) | n);
+    }
+}
+
+// ============================================================================
+// Line Kernels
+// ============================================================================
+// One word of indices per iteration. Two pair entries combine into a 1x word with
+// a single PKHBT, which the compiler emits for (a & 0xffff) | (b << 16).
+
+void __not_in_flash_func(video_palette_line_8bpp)(uint32_t *dst, const uint8_t *src, uint32_t pixels,
+                                                  const video_palette_t *palette)
+{
+    const uint32_t *pair = palette->pair;
+    const uint32_t *s = (const uint32_t *)src;
+    for (uint32_t n = pixels / 4; n; n--) {
+        uint32_t w = *s++;
+        uint32_t p0 = pair[w & 0xffu];
+        uint32_t p1 = pair[(w >> 8) & 0xffu];
+        uint32_t p2 = pair[(w >> 16) & 0xffu];
+        uint32_t p3 = pair[w >> 24];
+        dst[0] = (p0 & 0xffffu) | (p1 << 16);
+        dst[1] = (p2 & 0xffffu) | (p3 << 16);
+        dst += 2;
+    }
+}
+
+void __not_in_flash_func(video_palette_line_8bpp_2x)(uint32_t *dst, const uint8_t *src, uint32_t pixels,
+                                                     const video_palette_t *palette)
+{
+    const uint32_t *pair = palette->pair;
+    const uint32_t *s = (const uint32_t *)src;
+    for (uint32_t n = pixels / 4; n; n--) {
+        uint32_t w = *s++;
+        dst[0] = pair[w & 0xffu];
+        dst[1] = pair[(w >> 8) & 0xffu];
+        dst[2] = pair[(w >> 16) & 0xffu];
+        dst[3] = pair[w >> 24];
+        dst += 4;
+    }
+}
+
+void __not_in_flash_func(video_palette_line_4bpp)(uint32_t *dst, const uint8_t *src, uint32_t pixels,
+                                                  const video_palette_t *palette)
+{
+    const uint32_t *nibbles = palette->nibbles;
+    const uint32_t *s = (const uint32_t *)src;
+    for (uint32_t n = pixels / 8; n; n--) {
+        uint32_t w = *s++;
+        dst[0] = nibbles[w & 0xffu];
+        dst[1] = nibbles[(w >> 8) & 0xffu];
+        dst[2] = nibbles[(w >> 16) & 0xffu];
+        dst[3] = nibbles[w >> 24];
+        dst += 4;
+    }
+}
+
+void __not_in_flash_func(video_palette_line_4bpp_2x)(uint32_t *dst, const uint8_t *src, uint32_t pixels,
+                                                     const video_palette_t *palette)
+{
+    const uint32_t *pair = palette->pair;
+    const uint32_t *s = (const uint32_t *)src;
+    for (uint32_t n = pixels / 8; n; n--) {
+        uint32_t w = *s++;
+        dst[0] = pair[w & 0xfu];
+        dst[1] = pair[(w >> 4) & 0xfu];
+        dst[2] = pair[(w >> 8) & 0xfu];
+        dst[3] = pair[(w >> 12) & 0xfu];
+        dst[4] = pair[(w >> 16) & 0xfu];
+        dst[5] = pair[(w >> 20) & 0xfu];
+        dst[6] = pair[(w >> 24) & 0xfu];
+        dst[7] = pair[w >> 28];
+        dst += 8;
+    }
+}